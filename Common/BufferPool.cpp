@@ -0,0 +1,189 @@
+#include <sys/mman.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "BufferPool.h"
+
+namespace HalideExamples {
+
+namespace {
+
+// Every block starts with a header recording its size class. The header is as large as the
+// alignment, so the memory after it stays aligned for vector loads.
+const size_t ALIGNMENT = 64;
+const size_t MIN_BLOCK = 64;
+const size_t SLAB_SIZE = 2 << 20;
+
+struct BlockHeader {
+	uint32_t sizeClass;
+	char padding[ALIGNMENT - sizeof(uint32_t)];
+};
+
+size_t ClassSize(int sizeClass) {
+	return MIN_BLOCK << sizeClass;
+}
+
+int SizeClassFor(size_t size) {
+	size_t block = size + sizeof(BlockHeader);
+	int sizeClass = 0;
+	while (ClassSize(sizeClass) < block) {
+		++sizeClass;
+	}
+	return sizeClass;
+}
+
+}
+
+BufferPool::BufferPool()
+	: allocations(0)
+	, frees(0)
+	, poolHits(0)
+	, systemAllocations(0)
+	, bytesReserved(0)
+	, bytesInUse(0)
+{
+}
+
+BufferPool::~BufferPool() {
+	for (size_t i = 0; i < mappings.size(); ++i) {
+		munmap(mappings[i].first, mappings[i].second);
+	}
+}
+
+BufferPool& BufferPool::shared() {
+	static BufferPool pool;
+	return pool;
+}
+
+// Map size bytes (a multiple of SLAB_SIZE) aligned to SLAB_SIZE, so the kernel can back it with
+// huge pages
+void* BufferPool::mapFromSystem(size_t size) {
+	size_t padded = size + SLAB_SIZE;
+	void* raw = mmap(0, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) {
+		return 0;
+	}
+
+	// Trim the unaligned head and the leftover tail
+	uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+	uintptr_t aligned = (start + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1);
+	if (aligned > start) {
+		munmap(raw, aligned - start);
+	}
+	size_t tail = (start + padded) - (aligned + size);
+	if (tail > 0) {
+		munmap(reinterpret_cast<void*>(aligned + size), tail);
+	}
+
+	void* block = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+	madvise(block, size, MADV_HUGEPAGE);
+#endif
+
+	++systemAllocations;
+	bytesReserved += size;
+	std::lock_guard<std::mutex> lock(mappingsMutex);
+	mappings.push_back(std::make_pair(block, size));
+	return block;
+}
+
+// Put more blocks on a class's free list. Called with the class's mutex held.
+void BufferPool::refill(int sizeClass) {
+	size_t blockSize = ClassSize(sizeClass);
+	if (blockSize >= SLAB_SIZE) {
+		void* block = mapFromSystem(blockSize);
+		if (block) {
+			classes[sizeClass].freeBlocks.push_back(block);
+		}
+		return;
+	}
+
+	char* slab = static_cast<char*>(mapFromSystem(SLAB_SIZE));
+	if (!slab) {
+		return;
+	}
+	for (size_t offset = 0; offset + blockSize <= SLAB_SIZE; offset += blockSize) {
+		classes[sizeClass].freeBlocks.push_back(slab + offset);
+	}
+}
+
+void* BufferPool::allocate(size_t size) {
+	int sizeClass = SizeClassFor(size);
+	if (sizeClass >= NUM_CLASSES) {
+		return 0;
+	}
+
+	void* block;
+	{
+		SizeClass& c = classes[sizeClass];
+		std::lock_guard<std::mutex> lock(c.mutex);
+		if (c.freeBlocks.empty()) {
+			refill(sizeClass);
+			if (c.freeBlocks.empty()) {
+				return 0;
+			}
+		} else {
+			++poolHits;
+		}
+		block = c.freeBlocks.back();
+		c.freeBlocks.pop_back();
+	}
+
+	++allocations;
+	bytesInUse += ClassSize(sizeClass);
+	BlockHeader* header = static_cast<BlockHeader*>(block);
+	header->sizeClass = sizeClass;
+	return header + 1;
+}
+
+void BufferPool::free(void* ptr) {
+	if (!ptr) {
+		return;
+	}
+	BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+	int sizeClass = header->sizeClass;
+
+	++frees;
+	bytesInUse -= ClassSize(sizeClass);
+	SizeClass& c = classes[sizeClass];
+	std::lock_guard<std::mutex> lock(c.mutex);
+	c.freeBlocks.push_back(header);
+}
+
+BufferPool::Stats BufferPool::stats() const {
+	Stats s;
+	s.allocations = allocations;
+	s.frees = frees;
+	s.poolHits = poolHits;
+	s.systemAllocations = systemAllocations;
+	s.bytesReserved = bytesReserved;
+	s.bytesInUse = bytesInUse;
+	return s;
+}
+
+void BufferPool::printStats() const {
+	Stats s = stats();
+	std::printf("buffer pool: %llu allocations (%llu from pool), %llu frees, %llu system allocations, %.1f MB reserved, %.1f MB in use\n",
+		static_cast<unsigned long long>(s.allocations), static_cast<unsigned long long>(s.poolHits),
+		static_cast<unsigned long long>(s.frees), static_cast<unsigned long long>(s.systemAllocations),
+		s.bytesReserved / 1048576.0, s.bytesInUse / 1048576.0);
+}
+
+void* BufferPoolMalloc(void* userContext, size_t size) {
+	return BufferPool::shared().allocate(size);
+}
+
+void BufferPoolFree(void* userContext, void* ptr) {
+	BufferPool::shared().free(ptr);
+}
+
+void UseBufferPool(Halide::Func& f) {
+	f.set_custom_allocator(BufferPoolMalloc, BufferPoolFree);
+}
+
+void UseBufferPool(Halide::Pipeline& p) {
+	p.set_custom_allocator(BufferPoolMalloc, BufferPoolFree);
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef HalideExamples_BufferPool_h
+#define HalideExamples_BufferPool_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// A size-class allocator for the intermediate buffers Halide allocates on every realize.
+//
+// Requests are rounded up to a power-of-two size class. Freed blocks go onto their class's free
+// list and are handed out again on the next request, so once a pipeline has run a frame its
+// intermediates come from the pool without touching the system allocator. Blocks smaller than a
+// slab are carved out of 2MB slabs; larger blocks get their own mapping. Both are backed by
+// transparent huge pages where the kernel allows, to cut page faults and TLB misses on large
+// buffers.
+class BufferPool {
+public:
+	struct Stats {
+		uint64_t allocations;		// blocks handed out
+		uint64_t frees;				// blocks returned
+		uint64_t poolHits;			// allocations served from a free list
+		uint64_t systemAllocations;	// slabs and large blocks mapped from the system
+		uint64_t bytesReserved;		// total bytes mapped from the system
+		uint64_t bytesInUse;		// bytes in blocks currently handed out
+	};
+
+	BufferPool();
+	~BufferPool();
+
+	static BufferPool& shared();
+
+	void* allocate(size_t size);
+	void free(void* ptr);
+
+	Stats stats() const;
+	void printStats() const;
+
+private:
+	static const int NUM_CLASSES = 40;
+
+	struct SizeClass {
+		std::mutex mutex;
+		std::vector<void*> freeBlocks;
+	};
+
+	void* mapFromSystem(size_t size);
+	void refill(int sizeClass);
+
+	SizeClass classes[NUM_CLASSES];
+	std::mutex mappingsMutex;
+	std::vector<std::pair<void*, size_t> > mappings;
+
+	std::atomic<uint64_t> allocations;
+	std::atomic<uint64_t> frees;
+	std::atomic<uint64_t> poolHits;
+	std::atomic<uint64_t> systemAllocations;
+	std::atomic<uint64_t> bytesReserved;
+	std::atomic<uint64_t> bytesInUse;
+};
+
+// Halide runtime hooks backed by the shared pool
+void* BufferPoolMalloc(void* userContext, size_t size);
+void BufferPoolFree(void* userContext, void* ptr);
+
+// Allocate a pipeline's intermediate buffers from the shared pool
+void UseBufferPool(Halide::Func& f);
+void UseBufferPool(Halide::Pipeline& p);
+
+}
+
+#endif // HalideExamples_BufferPool_h
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#include "CpuDispatch.h"
+
+namespace HalideExamples {
+
+namespace {
+
+const char* ISA_NAMES[ISA_COUNT] = { "baseline", "sse41", "avx", "avx2" };
+
+const char* ISA_FEATURES[ISA_COUNT] = { "", "-sse41", "-sse41-avx", "-sse41-avx-avx2-fma-f16c" };
+
+// Wider vectors and tiles as the registers widen and multiply
+const ScheduleParams ISA_SCHEDULES[ISA_COUNT] = {
+	{  4, 256, 16,  8 },
+	{  8, 256, 16,  8 },
+	{ 16, 256, 32,  8 },
+	{ 32, 256, 32, 16 },
+};
+
+bool selected = false;
+IsaLevel currentLevel = ISA_BASELINE;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// Older compilers' __builtin_cpu_supports doesn't know F16C, so read it from CPUID leaf 1
+bool SupportsF16c() {
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C) != 0;
+}
+#endif
+
+}
+
+IsaLevel DetectIsa() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	// The avx2 variant is compiled with FMA and F16C too
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && SupportsF16c()) {
+		return ISA_AVX2;
+	}
+	if (__builtin_cpu_supports("avx")) {
+		return ISA_AVX;
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		return ISA_SSE41;
+	}
+#endif
+	return ISA_BASELINE;
+}
+
+IsaLevel SelectIsa(int argc, char** argv) {
+	IsaLevel detected = DetectIsa();
+	const std::string flag = "--isa=";
+	std::string requested;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg.compare(0, flag.size(), flag) == 0) {
+			requested = arg.substr(flag.size());
+		}
+	}
+	const char* env = std::getenv("HALIDE_EXAMPLES_ISA");
+	if (requested.empty() && env) {
+		requested = env;
+	}
+
+	currentLevel = detected;
+	if (!requested.empty()) {
+		IsaLevel level;
+		if (!ParseIsa(requested, level)) {
+			std::printf("Unknown ISA %s, using %s\n", requested.c_str(), IsaName(detected));
+		} else if (level > detected) {
+			std::printf("This CPU doesn't support %s, using %s\n", IsaName(level), IsaName(detected));
+		} else {
+			currentLevel = level;
+		}
+	}
+	selected = true;
+
+	setenv("HL_JIT_TARGET", IsaTargetString(currentLevel).c_str(), 1);
+	std::printf("Running the %s variant (%s)\n", IsaName(currentLevel), IsaTargetString(currentLevel).c_str());
+	return currentLevel;
+}
+
+IsaLevel CurrentIsa() {
+	if (!selected) {
+		currentLevel = DetectIsa();
+		selected = true;
+	}
+	return currentLevel;
+}
+
+const char* IsaName(IsaLevel level) {
+	return ISA_NAMES[level];
+}
+
+bool ParseIsa(const std::string& name, IsaLevel& level) {
+	for (int i = 0; i < ISA_COUNT; ++i) {
+		if (name == ISA_NAMES[i]) {
+			level = static_cast<IsaLevel>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string IsaTargetString(IsaLevel level) {
+#if defined(__APPLE__)
+	const char* os = "osx";
+#else
+	const char* os = "linux";
+#endif
+	const char* bits = sizeof(void*) == 8 ? "64" : "32";
+	return std::string("x86-") + bits + "-" + os + ISA_FEATURES[level];
+}
+
+Halide::Target IsaTarget(IsaLevel level) {
+	return Halide::parse_target_string(IsaTargetString(level));
+}
+
+const ScheduleParams& IsaSchedule(IsaLevel level) {
+	return ISA_SCHEDULES[level];
+}
+
+const ScheduleParams& CurrentSchedule() {
+	return IsaSchedule(CurrentIsa());
+}
+
+Halide::Target CompileForIsa(Halide::Func& f) {
+	Halide::Target target = IsaTarget(CurrentIsa());
+	f.compile_jit(target);
+	return target;
+}
+
+}
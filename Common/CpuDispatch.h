@@ -0,0 +1,56 @@
+#ifndef HalideExamples_CpuDispatch_h
+#define HalideExamples_CpuDispatch_h
+
+#include <string>
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// x86 feature levels the pipelines are compiled for. AVX2 also enables FMA and F16C. Machines
+// with AVX-512 run the AVX2 variant.
+enum IsaLevel {
+	ISA_BASELINE,	// SSE2 only
+	ISA_SSE41,
+	ISA_AVX,
+	ISA_AVX2,
+	ISA_COUNT
+};
+
+// Schedule constants tuned per feature level
+struct ScheduleParams {
+	int vectorWidth;	// vector width of the 1D kernels
+	int blockSize;		// parallel block edge of the 2D kernels
+	int tileWidth;		// vectorized tile within a block
+	int tileHeight;		// unrolled rows within a tile
+};
+
+// Best level supported by this CPU, from CPUID
+IsaLevel DetectIsa();
+
+// Pick the level to run, in order of preference from an --isa=<name> argument, the
+// HALIDE_EXAMPLES_ISA environment variable, or DetectIsa(). Levels the CPU doesn't support fall
+// back to the detected one. Also points HL_JIT_TARGET at the level, so pipelines compiled on
+// first realize use it too.
+IsaLevel SelectIsa(int argc, char** argv);
+
+// The level picked by SelectIsa(), or the detected one if it hasn't been called
+IsaLevel CurrentIsa();
+
+const char* IsaName(IsaLevel level);
+bool ParseIsa(const std::string& name, IsaLevel& level);
+
+// Halide target string and target for a level, on the host OS
+std::string IsaTargetString(IsaLevel level);
+Halide::Target IsaTarget(IsaLevel level);
+
+const ScheduleParams& IsaSchedule(IsaLevel level);
+const ScheduleParams& CurrentSchedule();
+
+// JIT-compile a pipeline for the current level. Pass the returned target to realize() as well:
+// realizing for any other target, such as the default from HL_JIT_TARGET, compiles it again.
+Halide::Target CompileForIsa(Halide::Func& f);
+
+}
+
+#endif // HalideExamples_CpuDispatch_h
@@ -0,0 +1,31 @@
+#ifndef HalideExamples_FastMath_h
+#define HalideExamples_FastMath_h
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// Precision of the transcendental math in the pair and spring kernels
+enum MathPrecision {
+	PRECISION_EXACT,	// sqrt and full-precision divides
+	PRECISION_FAST		// hardware reciprocal square root estimate with one Newton iteration
+};
+
+// 1 / sqrt(x) from the hardware estimate, refined by one Newton-Raphson iteration to about 22 bits.
+// Written as multiply-adds so targets with FMA can fuse them.
+inline Halide::Expr FastInverseSqrt(Halide::Expr x) {
+	Halide::Expr y = Halide::fast_inverse_sqrt(x);
+	Halide::Expr halfx = 0.5f * x;
+	return y * (1.5f - halfx * y * y);
+}
+
+inline Halide::Expr InverseSqrt(Halide::Expr x, MathPrecision precision) {
+	if (precision == PRECISION_FAST) {
+		return FastInverseSqrt(x);
+	}
+	return 1.0f / Halide::sqrt(x);
+}
+
+}
+
+#endif // HalideExamples_FastMath_h
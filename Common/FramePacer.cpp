@@ -0,0 +1,63 @@
+#include <algorithm>
+
+#include "FramePacer.h"
+
+namespace HalideExamples {
+
+namespace {
+
+// Weight of the newest sample in the running cost estimates
+const double COST_SMOOTHING = 0.1;
+
+}
+
+FramePacer::FramePacer(double stepsPerSecond, double frameMs)
+	: stepsPerSecond(stepsPerSecond)
+	, frameDuration(frameMs)
+	// Until we've measured, assume a step takes the whole frame
+	, stepCostMs(frameMs)
+	, renderCostMs(0.0)
+	, accumulator(0.0)
+{
+}
+
+int FramePacer::substeps(double elapsedSeconds) {
+	// As many steps as fit in the frame alongside rendering, but at least one
+	double budget = frameDuration - renderCostMs;
+	int affordable = std::max(1, static_cast<int>(budget / std::max(stepCostMs, 1e-3)));
+	if (stepsPerSecond <= 0.0) {
+		return affordable;
+	}
+
+	accumulator += elapsedSeconds * stepsPerSecond;
+	int substeps = static_cast<int>(accumulator);
+	// Drop the time we can't keep up with rather than falling further behind
+	if (substeps > affordable) {
+		substeps = affordable;
+		accumulator = substeps;
+	}
+	accumulator -= substeps;
+	return substeps;
+}
+
+void FramePacer::recordStep(double ms) {
+	stepCostMs += COST_SMOOTHING * (ms - stepCostMs);
+}
+
+void FramePacer::recordRender(double ms) {
+	renderCostMs += COST_SMOOTHING * (ms - renderCostMs);
+}
+
+double FramePacer::frameMs() const {
+	return frameDuration;
+}
+
+double FramePacer::stepMs() const {
+	return stepCostMs;
+}
+
+double FramePacer::renderMs() const {
+	return renderCostMs;
+}
+
+}
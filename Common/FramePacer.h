@@ -0,0 +1,38 @@
+#ifndef HalideExamples_FramePacer_h
+#define HalideExamples_FramePacer_h
+
+namespace HalideExamples {
+
+// Decides how many fixed timesteps each frame of FrameScheduler takes. It has no clock or display
+// of its own: the caller reports the time between frames and the measured cost of each step and
+// render, so the pacing can be tested without SDL.
+//
+// Steps accumulate against elapsed time at stepsPerSecond, but a frame never takes more steps than
+// fit in it alongside rendering; the time it can't keep up with is dropped rather than owed. With
+// stepsPerSecond = 0 each frame takes as many steps as fit, and at least one.
+class FramePacer {
+public:
+	FramePacer(double stepsPerSecond, double frameMs);
+
+	// Steps to take in a frame that starts elapsedSeconds after the previous one
+	int substeps(double elapsedSeconds);
+
+	// Fold the measured cost of a step or a render into the running estimates
+	void recordStep(double ms);
+	void recordRender(double ms);
+
+	double frameMs() const;
+	double stepMs() const;
+	double renderMs() const;
+
+private:
+	double stepsPerSecond;
+	double frameDuration;
+	double stepCostMs;
+	double renderCostMs;
+	double accumulator;
+};
+
+}
+
+#endif // HalideExamples_FramePacer_h
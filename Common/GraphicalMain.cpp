@@ -1,14 +1,128 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
 #include "Graphics.h"
+#include "CpuDispatch.h"
 
 namespace HalideExamples {
 
 void RunDemo(int width, int height);
 
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double ElapsedMs(Clock::time_point since) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// Refresh period of the display, or 60Hz if SDL doesn't know it
+double DisplayFrameMs() {
+	SDL_DisplayMode mode;
+	if (SDL_GetCurrentDisplayMode(0, &mode) == 0 && mode.refresh_rate > 0) {
+		return 1000.0 / mode.refresh_rate;
+	}
+	return 1000.0 / 60.0;
+}
+
+bool verbose = false;
+
+}
+
+bool Verbose() {
+	return verbose;
+}
+
+FrameScheduler::FrameScheduler(double stepsPerSecond)
+	: pacer(stepsPerSecond, DisplayFrameMs())
+	, stopped(false)
+	, finalSubstep(false)
+	, stepCount(0)
+	, frameCount(0)
+{
+}
+
+void FrameScheduler::run(const std::function<void()>& step, const std::function<void()>& render, unsigned int maxSteps) {
+	Clock::time_point last = Clock::now();
+	while (!stopped && (maxSteps == 0 || stepCount < maxSteps)) {
+		Clock::time_point frameStart = Clock::now();
+		pumpEvents();
+
+		int substeps = pacer.substeps(std::chrono::duration<double>(frameStart - last).count());
+		last = frameStart;
+		if (maxSteps != 0) {
+			substeps = std::min(substeps, static_cast<int>(maxSteps - stepCount));
+		}
+
+		for (int i = 0; i < substeps && !stopped; ++i) {
+			Clock::time_point stepStart = Clock::now();
+			finalSubstep = i == substeps - 1;
+			step();
+			pacer.recordStep(ElapsedMs(stepStart));
+			++stepCount;
+		}
+		finalSubstep = false;
+
+		Clock::time_point renderStart = Clock::now();
+		render();
+		pacer.recordRender(ElapsedMs(renderStart));
+		++frameCount;
+
+		// Present at the display rate when we're ahead of it
+		double spent = ElapsedMs(frameStart);
+		if (spent < pacer.frameMs()) {
+			SDL_Delay(static_cast<Uint32>(pacer.frameMs() - spent));
+		}
+	}
+}
+
+void FrameScheduler::stop() {
+	stopped = true;
+}
+
+unsigned int FrameScheduler::steps() const {
+	return stepCount;
+}
+
+unsigned int FrameScheduler::frames() const {
+	return frameCount;
+}
+
+double FrameScheduler::stepMs() const {
+	return pacer.stepMs();
+}
+
+bool FrameScheduler::lastSubstep() const {
+	return finalSubstep;
+}
+
+void FrameScheduler::pumpEvents() {
+	SDL_Event event;
+	while (SDL_PollEvent(&event)) {
+		if (event.type == SDL_QUIT) {
+			stopped = true;
+		} else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE) {
+			stopped = true;
+		}
+	}
+}
+
 }
 
 using namespace HalideExamples;
 
 int main(int argc, char** argv) {
+	// Pick the pipeline variant before anything is compiled. --isa=<name> overrides CPUID.
+	SelectIsa(argc, argv);
+
+	const char* verboseEnv = std::getenv("HALIDE_EXAMPLES_VERBOSE");
+	verbose = verboseEnv && std::atoi(verboseEnv);
+	for (int i = 1; i < argc; ++i) {
+		verbose = verbose || std::strcmp(argv[i], "--verbose") == 0;
+	}
+
 	InitializeGraphics();
 
 	RunDemo(SCREEN_WIDTH, SCREEN_HEIGHT);
@@ -1,9 +1,14 @@
 #include <cstdlib>
 #include <cstdio>
 #include <algorithm>
+#include <cmath>
 
 #include "Graphics.h"
 #include "Vec.h"
+#include "ThreadPool.h"
+#include "BufferPool.h"
+#include "CpuDispatch.h"
+#include "Shading.h"
 
 using namespace Halide;
 
@@ -17,6 +22,25 @@ Param<float> maxvalue;
 Func imageConverter;
 Func imageConverterMinMaxProvided;
 
+// Display pyramid. Level L reduces each 2^L x 2^L block of the source image to one pixel; level 0 is
+// the source itself. Only the window of the chosen level that is on screen is computed, straight
+// from the source.
+ImageParam pyramidInput(type_of<float>(), 2);
+Param<int> pyramidFactor;
+Param<int> windowX;
+Param<int> windowY;
+Func averageDownsampler;
+Func maxDownsampler;
+Image<float> visibleLevel;
+
+// Viewport conversion samples one pyramid level onto the screen
+ImageParam viewLevel(type_of<float>(), 2);
+Param<float> viewX;
+Param<float> viewY;
+Param<float> viewStep;
+Func viewportConverter;
+Func viewportConverterMinMaxProvided;
+
 namespace HalideExamples {
 
 void GetImageMinMax(Halide::Image<float>& image, float& min, float& max) {
@@ -53,19 +77,21 @@ Func InitializeDiffuseShader(Image<float>& input, Param<float> &lx, Param<float>
 
 	// Now schedule it.
 
-	// Split the space into 256x256 blocks for parallelization
+	// Split the space into blocks for parallelization, then into tiles sized for the ISA
+	const ScheduleParams& schedule = CurrentSchedule();
 	Var xi, yi, xo, yo;
 	Var tx, ty, nx, ny, ti;
-	shade.tile(x, y, tx, ty, nx, ny, 256, 256);
+	shade.tile(x, y, tx, ty, nx, ny, schedule.blockSize, schedule.blockSize);
 
-	// Split the blocks into smaller 32x16 tiles, vectorize and unroll
-	shade.tile(nx, ny, xo, yo, xi, yi, 32, 16)
+	// Vectorize and unroll the tiles
+	shade.tile(nx, ny, xo, yo, xi, yi, schedule.tileWidth, schedule.tileHeight)
 		.vectorize(xi)
 		.unroll(yi);
 
 	// Run all blocks in parallel
 	shade.fuse(tx, ty, ti);
 	shade.parallel(ti);
+	UseThreadPool(shade);
 
 	return shade;
 }
@@ -74,46 +100,27 @@ Func InitializeSpecularShader(Image<float>& input, Param<float> &lx, Param<float
 	Func shade;
 	Var x, y;
 
-	// Compute the surface normal as the cross product of the tangent vectors along X and Y
-	Vec tangentX(1, 0, (input(x + 1, y) - input(x - 1, y)) / 2);
-	Vec tangentY(0, 1, (input(x, y + 1) - input(x, y - 1)) / 2);
-	Vec normal = cross(tangentX, tangentY).normalized();
-
-	// Compute the vector to the light source
-	Vec l = (Vec(lx, ly, lz) - Vec(x, y, input(x, y))).normalized();
-
-	// Compute the diffuse illumination as the dot product of light vector and normal vector
-	// (proportional to cos(a) between the two)
-	Expr diffuse = dot(l, normal);
-
-	// Now calculate specular reflection
-
-	// Reflect an eye ray about the normal
-	Vec eye = Vec(x - ex, y - ey, input(x, y) - ez).normalized();
-	Vec reflect = eye - 2 * dot(eye, normal) * normal;
-
-	// If the angle is "very close", i.e. the reflected ray intersects the spherical light source,
-	// add a highlight
-	Expr specular = select(dot(l, reflect) > 0.98f, 0.5f, 0);
-
-	// The result is the sum of diffuse and specular, normalized to 0..1 range
-	shade(x, y) = (diffuse + specular) / 1.5f;
+	Func height;
+	height(x, y) = input(x, y);
+	shade(x, y) = SpecularShade(height, x, y, lx, ly, lz, ex, ey, ez);
 
 	// Now schedule it.
 
-	// Split the space into 256x256 blocks for parallelization
+	// Split the space into blocks for parallelization, then into tiles sized for the ISA
+	const ScheduleParams& schedule = CurrentSchedule();
 	Var xi, yi, xo, yo;
 	Var tx, ty, nx, ny, ti;
-	shade.tile(x, y, tx, ty, nx, ny, 256, 256);
+	shade.tile(x, y, tx, ty, nx, ny, schedule.blockSize, schedule.blockSize);
 
-	// Split the blocks into smaller 32x16 tiles, vectorize and unroll
-	shade.tile(nx, ny, xo, yo, xi, yi, 32, 16)
+	// Vectorize and unroll the tiles
+	shade.tile(nx, ny, xo, yo, xi, yi, schedule.tileWidth, schedule.tileHeight)
 		.vectorize(xi)
 		.unroll(yi);
 
 	// Run all blocks in parallel
 	shade.fuse(tx, ty, ti);
 	shade.parallel(ti);
+	UseThreadPool(shade);
 
 	return shade;
 }
@@ -142,6 +149,7 @@ Func InitializeImageConverter() {
 	rescaled.tile(x, y, xo, yo, xi, yi, 32, 8);
 	rescaled.vectorize(xi);
 	rescaled.unroll(yi);
+	UseBufferPool(rescaled);
 
 	return rescaled;
 }
@@ -163,9 +171,105 @@ Func InitializeImageConverterMinMaxProvided() {
 	return rescaled;
 }
 
+Func InitializeDownsampler(DownsampleMode mode) {
+	Func clamped = BoundaryConditions::repeat_edge(pyramidInput);
+	Func down;
+	Var x, y;
+
+	// Reduce each factor x factor block of the source to a single pixel. (x, y) is relative to
+	// the window's corner in the level.
+	RDom r(0, pyramidFactor, 0, pyramidFactor);
+	Expr sx = (x + windowX) * pyramidFactor + r.x;
+	Expr sy = (y + windowY) * pyramidFactor + r.y;
+	if (mode == DOWNSAMPLE_MAX) {
+		down(x, y) = maximum(clamped(sx, sy));
+	} else {
+		down(x, y) = sum(clamped(sx, sy)) / cast<float>(pyramidFactor * pyramidFactor);
+	}
+
+	Var xo, yo, xi, yi;
+	down.tile(x, y, xo, yo, xi, yi, 32, 8)
+		.vectorize(xi)
+		.parallel(yo);
+	UseThreadPool(down);
+
+	return down;
+}
+
+// Nearest-neighbour sample of the current pyramid level for each screen pixel
+Func ViewportSampler(Var x, Var y, Expr& inside) {
+	Expr sx = cast<int>(Halide::floor(viewX + (x + 0.5f) * viewStep));
+	Expr sy = cast<int>(Halide::floor(viewY + (y + 0.5f) * viewStep));
+	inside = sx >= 0 && sx < viewLevel.width() && sy >= 0 && sy < viewLevel.height();
+
+	Func sampled;
+	sampled(x, y) = viewLevel(clamp(sx, 0, viewLevel.width() - 1), clamp(sy, 0, viewLevel.height() - 1));
+	return sampled;
+}
+
+Func InitializeViewportConverter() {
+	Var x, y;
+	Expr inside;
+	Func sampled = ViewportSampler(x, y, inside);
+
+	// Get min and max over the visible pixels only, so the cost depends on the screen size
+	RDom r(0, SCREEN_WIDTH, 0, SCREEN_HEIGHT);
+	Func imgmin;
+	imgmin() = minimum(sampled(r.x, r.y));
+	Func imgmax;
+	imgmax() = maximum(sampled(r.x, r.y));
+	Expr scale = 1.0f / (imgmax() - imgmin());
+	Func rescaled;
+	Expr val = cast<uint32_t>(255.0f * (sampled(x, y) - imgmin()) * scale + 0.5f);
+	Expr scaled = val * cast<uint32_t>(0x00010101);
+	rescaled(x, y) = select(inside, scaled, cast<uint32_t>(0));
+
+	Var xo, yo, xi, yi;
+	sampled.compute_root();
+	sampled.tile(x, y, xo, yo, xi, yi, 32, 8)
+		.vectorize(xi)
+		.parallel(yo);
+	imgmin.compute_root();
+	imgmax.compute_root();
+
+	rescaled.tile(x, y, xo, yo, xi, yi, 32, 8)
+		.vectorize(xi)
+		.unroll(yi)
+		.parallel(yo);
+	UseThreadPool(rescaled);
+	UseBufferPool(rescaled);
+
+	return rescaled;
+}
+
+Func InitializeViewportConverterMinMaxProvided() {
+	Var x, y;
+	Expr inside;
+	Func sampled = ViewportSampler(x, y, inside);
+
+	Expr scale = 1.0f / (maxvalue - minvalue);
+	Func rescaled;
+	Expr val = cast<uint32_t>(255.0f * (clamp(sampled(x, y), minvalue, maxvalue) - minvalue) * scale + 0.5f);
+	Expr scaled = val * cast<uint32_t>(0x00010101);
+	rescaled(x, y) = select(inside, scaled, cast<uint32_t>(0));
+
+	Var xo, yo, xi, yi;
+	rescaled.tile(x, y, xo, yo, xi, yi, 32, 8)
+		.vectorize(xi)
+		.unroll(yi)
+		.parallel(yo);
+	UseThreadPool(rescaled);
+
+	return rescaled;
+}
+
 void InitializeGraphics() {
 	imageConverter = InitializeImageConverter();
 	imageConverterMinMaxProvided = InitializeImageConverterMinMaxProvided();
+	averageDownsampler = InitializeDownsampler(DOWNSAMPLE_AVERAGE);
+	maxDownsampler = InitializeDownsampler(DOWNSAMPLE_MAX);
+	viewportConverter = InitializeViewportConverter();
+	viewportConverterMinMaxProvided = InitializeViewportConverterMinMaxProvided();
 
 	int ec = SDL_Init(SDL_INIT_VIDEO);
 	if (ec < 0) {
@@ -196,9 +300,8 @@ void TerminateGraphics() {
 	SDL_Quit();
 }
 
-void DisplayImage(Halide::Image<float>& image) {
-	::image.set(image);
-
+// Run a converter into the streaming texture and present it
+void RealizeToTexture(Func& converter) {
 	void* vpixels;
 	int pitch;
 	SDL_LockTexture(mainTexture, 0, &vpixels, &pitch);
@@ -214,38 +317,90 @@ void DisplayImage(Halide::Image<float>& image) {
 	pixbuf.elem_size = 4;
 
 	Buffer output(type_of<uint32_t>(), &pixbuf);
-	imageConverter.realize(output);
+	converter.realize(output);
 
 	SDL_UnlockTexture(mainTexture);
 	SDL_RenderCopy(mainRenderer, mainTexture, 0, 0);
 	SDL_RenderPresent(mainRenderer);
 }
 
+void DisplayImage(Halide::Image<float>& image) {
+	::image.set(image);
+	RealizeToTexture(imageConverter);
+}
+
 void DisplayImage(Halide::Image<float>& image, float min, float max) {
 	::image.set(image);
+	minvalue.set(min);
+	maxvalue.set(max);
+	RealizeToTexture(imageConverterMinMaxProvided);
+}
 
-	void* vpixels;
-	int pitch;
-	SDL_LockTexture(mainTexture, 0, &vpixels, &pitch);
-	uint8_t* pixels = reinterpret_cast<uint8_t*>(vpixels);
+// Pick the pyramid level that best matches the zoom, compute the part of it that is on screen and
+// bind that to the viewport converter. The cost follows the visible region, not the image size.
+void SelectViewLevel(Halide::Image<float>& image, const Viewport& view, DownsampleMode mode) {
+	int level = 0;
+	while ((2 << level) <= view.zoom && (image.width() >> level) > 1 && (image.height() >> level) > 1) {
+		++level;
+	}
+	if (level == 0) {
+		viewLevel.set(image);
+		viewX.set(view.x);
+		viewY.set(view.y);
+		viewStep.set(view.zoom);
+		return;
+	}
 
-	// Create buffer_t to wrap the surface
-	buffer_t pixbuf = { 0 };
-	pixbuf.host = pixels;
-	pixbuf.extent[0] = SCREEN_WIDTH;
-	pixbuf.extent[1] = SCREEN_HEIGHT;
-	pixbuf.stride[0] = 1;
-	pixbuf.stride[1] = pitch / 4;
-	pixbuf.elem_size = 4;
+	// Window of the level under the screen, clipped to the level
+	int factor = 1 << level;
+	int levelWidth = (image.width() + factor - 1) / factor;
+	int levelHeight = (image.height() + factor - 1) / factor;
+	float levelScale = 1.0f / factor;
+	int x0 = std::max(0, static_cast<int>(std::floor(view.x * levelScale)));
+	int y0 = std::max(0, static_cast<int>(std::floor(view.y * levelScale)));
+	int x1 = std::min(levelWidth, static_cast<int>(std::floor((view.x + SCREEN_WIDTH * view.zoom) * levelScale)) + 1);
+	int y1 = std::min(levelHeight, static_cast<int>(std::floor((view.y + SCREEN_HEIGHT * view.zoom) * levelScale)) + 1);
+	x0 = std::min(x0, levelWidth - 1);
+	y0 = std::min(y0, levelHeight - 1);
+	int windowWidth = std::max(1, x1 - x0);
+	int windowHeight = std::max(1, y1 - y0);
+
+	if (!visibleLevel.defined() || visibleLevel.width() != windowWidth || visibleLevel.height() != windowHeight) {
+		visibleLevel = Image<float>(windowWidth, windowHeight);
+	}
+	Func& downsampler = mode == DOWNSAMPLE_MAX ? maxDownsampler : averageDownsampler;
+	pyramidInput.set(image);
+	pyramidFactor.set(factor);
+	windowX.set(x0);
+	windowY.set(y0);
+	downsampler.realize(visibleLevel);
+
+	// Screen pixels outside the window are outside the level too, so they still come out black
+	viewLevel.set(visibleLevel);
+	viewX.set(view.x * levelScale - x0);
+	viewY.set(view.y * levelScale - y0);
+	viewStep.set(view.zoom * levelScale);
+}
 
-	Buffer output(type_of<uint32_t>(), &pixbuf);
+void DisplayImage(Halide::Image<float>& image, const Viewport& view, DownsampleMode mode) {
+	SelectViewLevel(image, view, mode);
+	RealizeToTexture(viewportConverter);
+}
+
+void DisplayImage(Halide::Image<float>& image, const Viewport& view, float min, float max, DownsampleMode mode) {
+	SelectViewLevel(image, view, mode);
 	minvalue.set(min);
 	maxvalue.set(max);
-	imageConverterMinMaxProvided.realize(output);
+	RealizeToTexture(viewportConverterMinMaxProvided);
+}
 
-	SDL_UnlockTexture(mainTexture);
-	SDL_RenderCopy(mainRenderer, mainTexture, 0, 0);
-	SDL_RenderPresent(mainRenderer);
+// A viewport showing the whole of a width x height image, centered
+Viewport FitViewport(int width, int height) {
+	Viewport view;
+	view.zoom = std::max(static_cast<float>(width) / SCREEN_WIDTH, static_cast<float>(height) / SCREEN_HEIGHT);
+	view.x = 0.5f * (width - view.zoom * SCREEN_WIDTH);
+	view.y = 0.5f * (height - view.zoom * SCREEN_HEIGHT);
+	return view;
 }
 
 
@@ -1,10 +1,14 @@
 #ifndef HalideExamples_Graphics_h
 #define HalideExamples_Graphics_h
 
+#include <functional>
+
 #include <SDL.h>
 
 #include <Halide.h>
 
+#include "FramePacer.h"
+
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
 extern SDL_Window* mainWindow;
@@ -13,10 +17,64 @@ extern SDL_Texture* mainTexture;
 
 namespace HalideExamples {
 
+	// The region of a source image shown on screen. (x, y) is the source coordinate of the top-left
+	// corner of the screen, and zoom is the number of source pixels per screen pixel (> 1 zooms out).
+	struct Viewport {
+		float x;
+		float y;
+		float zoom;
+	};
+
+	// How blocks of source pixels are reduced to one pixel of a zoomed-out pyramid level
+	enum DownsampleMode {
+		DOWNSAMPLE_AVERAGE,	// box filter, for smooth fields
+		DOWNSAMPLE_MAX		// max-pool, keeps isolated bright points visible
+	};
+
+	// Main loop shared by the demos, in GraphicalMain.cpp.
+	//
+	// The simulation advances in fixed timesteps on an accumulator against the wall clock, and a
+	// frame is presented at the display's refresh rate. The substeps taken per frame adapt to the
+	// measured cost of a step and of rendering, so a slow kernel slows the simulation down instead
+	// of the display; see FramePacer. SDL events are pumped between frames without blocking;
+	// closing the window or pressing Escape stops the loop.
+	class FrameScheduler {
+	public:
+		explicit FrameScheduler(double stepsPerSecond = 0.0);
+
+		// Loop until stopped or maxSteps steps have been taken (0 = no limit)
+		void run(const std::function<void()>& step, const std::function<void()>& render, unsigned int maxSteps = 0);
+		void stop();
+
+		unsigned int steps() const;
+		unsigned int frames() const;
+		double stepMs() const;
+
+		// True during the last step before a frame is rendered, so a step can produce what the
+		// frame will show
+		bool lastSubstep() const;
+
+	private:
+		void pumpEvents();
+
+		FramePacer pacer;
+		bool stopped;
+		bool finalSubstep;
+		unsigned int stepCount;
+		unsigned int frameCount;
+	};
+
+	// True if the demo was started with --verbose or HALIDE_EXAMPLES_VERBOSE=1. The demos print
+	// their per-step statistics only then.
+	bool Verbose();
+
 	void InitializeGraphics();
 	void TerminateGraphics();
 	void DisplayImage(Halide::Image<float>& image);
 	void DisplayImage(Halide::Image<float>& image, float min, float max);
+	void DisplayImage(Halide::Image<float>& image, const Viewport& view, DownsampleMode mode = DOWNSAMPLE_AVERAGE);
+	void DisplayImage(Halide::Image<float>& image, const Viewport& view, float min, float max, DownsampleMode mode = DOWNSAMPLE_AVERAGE);
+	Viewport FitViewport(int width, int height);
 	Halide::Func InitializeDiffuseShader(Halide::Image<float>& input, Halide::Param<float> &lx, Halide::Param<float>& ly, Halide::Param<float>& lz);
 	Halide::Func InitializeSpecularShader(Halide::Image<float>& input, Halide::Param<float> &lx, Halide::Param<float>& ly, Halide::Param<float>& lz, Halide::Param<float> &ex, Halide::Param<float>& ey, Halide::Param<float>& ez);
 }
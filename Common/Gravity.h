@@ -0,0 +1,181 @@
+#ifndef HalideExamples_Gravity_h
+#define HalideExamples_Gravity_h
+
+#include <limits>
+
+#include <Halide.h>
+
+#include "CpuDispatch.h"
+#include "FastMath.h"
+#include "Telemetry.h"
+#include "Vec.h"
+
+namespace HalideExamples {
+
+// Particle state is stored as 7 planes along the second dimension:
+//   0-2: position
+//   3-5: velocity
+//   6:   mass
+
+// Gravitational acceleration of a particle at x0 towards a particle of the given mass at x1
+inline Vec GravitationalAcceleration(const Vec& x0, const Vec& x1, Halide::Expr mass, Halide::Expr gravity,
+									 MathPrecision precision = PRECISION_EXACT) {
+	Vec dx = x1 - x0;
+	Halide::Expr r2 = dx.magnitudeSquared();
+	// Let r2 be no smaller than 1.0f, to avoid particles blasting off from each other when they
+	// get too close. This also avoids dividing by zero.
+	r2 = Halide::max(1.0f, r2);
+	if (precision == PRECISION_FAST) {
+		// 1 / r^3 from one reciprocal square root, with no divide
+		Halide::Expr invr = FastInverseSqrt(r2);
+		Halide::Expr k = gravity * mass * (invr * invr * invr);
+		return k * dx;
+	}
+	Halide::Expr r = Halide::sqrt(r2);
+	return gravity * mass * dx / (r * r2);
+}
+
+// Gravitational potential at x0 due to a particle of the given mass at x1, softened like
+// GravitationalAcceleration
+inline Halide::Expr GravitationalPotential(const Vec& x0, const Vec& x1, Halide::Expr mass, Halide::Expr gravity,
+										   MathPrecision precision = PRECISION_EXACT) {
+	Vec dx = x1 - x0;
+	Halide::Expr r2 = Halide::max(1.0f, dx.magnitudeSquared());
+	return -gravity * mass * InverseSqrt(r2, precision);
+}
+
+// Quantities in the telemetry output of Gravity, per block of GRAVITY_TELEMETRY_BLOCK particles
+const int GRAVITY_TELEMETRY_BLOCK = 256;
+const int GRAVITY_TELEMETRY_COUNT = 9;
+const TelemetryQuantity GRAVITY_TELEMETRY[GRAVITY_TELEMETRY_COUNT] = {
+	{ "kinetic", REDUCE_SUM },
+	{ "potential", REDUCE_SUM },
+	{ "momentum_x", REDUCE_SUM },
+	{ "momentum_y", REDUCE_SUM },
+	{ "momentum_z", REDUCE_SUM },
+	{ "min_x", REDUCE_MIN },
+	{ "min_y", REDUCE_MIN },
+	{ "max_x", REDUCE_MAX },
+	{ "max_y", REDUCE_MAX },
+};
+
+// If telemetry is given, it is defined as the per-block partials of the input state as
+// telemetry(block, quantity), for realizing alongside the result in one Pipeline. The potential
+// is accumulated in the same loop over pairs as the force.
+template <typename INPUT>
+Halide::Func Gravity(INPUT input, Halide::Expr gravity, MathPrecision precision = PRECISION_EXACT,
+					 const ScheduleParams& schedule = CurrentSchedule(), Halide::Func* telemetry = 0) {
+	Halide::Var i;
+
+	// Compute the cumulative force on each particle
+	Halide::RDom j(0, input.width());
+
+	// Compute the gravitational acceleration vector between a pair of
+	// particles
+	Vec x0(input(i, 0), input(i, 1), input(i, 2));
+	Vec x1(input(j, 0), input(j, 1), input(j, 2));
+	Vec a = GravitationalAcceleration(x0, x1, input(j, 6), gravity, precision);
+
+	// Compute the cumulative force, and the potential alongside it for telemetry
+	Halide::Func cumulativeForce;
+	if (telemetry) {
+		Halide::Expr potential = GravitationalPotential(x0, x1, input(j, 6), gravity, precision);
+		cumulativeForce(i) = Halide::Tuple(0.0f, 0.0f, 0.0f, 0.0f);
+		cumulativeForce(i) = Halide::Tuple(cumulativeForce(i)[0] + a.x, cumulativeForce(i)[1] + a.y,
+										   cumulativeForce(i)[2] + a.z, cumulativeForce(i)[3] + potential);
+		cumulativeForce.update().vectorize(i, schedule.vectorWidth);
+	} else {
+		cumulativeForce(i) = Halide::Tuple(Halide::sum(a.x), Halide::sum(a.y), Halide::sum(a.z));
+	}
+
+	cumulativeForce.vectorize(i, schedule.vectorWidth);
+	cumulativeForce.compute_root();
+
+	// Compute the updated positions
+	Halide::Func updated;
+	Halide::Var k;
+	updated(i, k) = 0.0f;
+	updated(i, 0) = input(i, 0) + input(i, 3);
+	updated(i, 1) = input(i, 1) + input(i, 4);
+	updated(i, 2) = input(i, 2) + input(i, 5);
+	updated(i, 3) = input(i, 3) + cumulativeForce(i)[0];
+	updated(i, 4) = input(i, 4) + cumulativeForce(i)[1];
+	updated(i, 5) = input(i, 5) + cumulativeForce(i)[2];
+	updated(i, 6) = input(i, 6);
+
+	for (int up = 0; up < 6; ++up) {
+		updated.update(up).vectorize(i, schedule.vectorWidth);
+	}
+
+	if (telemetry) {
+		Halide::Var b;
+		Halide::RDom r(0, GRAVITY_TELEMETRY_BLOCK);
+		Halide::Expr n = input.width();
+		Halide::Expr index = b * GRAVITY_TELEMETRY_BLOCK + r;
+		Halide::Expr valid = index < n;
+		Halide::Expr p = Halide::min(index, n - 1);
+		Halide::Expr mass = input(p, 6);
+		Halide::Expr kinetic = 0.5f * mass * (input(p, 3) * input(p, 3) + input(p, 4) * input(p, 4) + input(p, 5) * input(p, 5));
+		// Each pair is counted from both ends, and the sum over j includes a softened self term
+		Halide::Expr potential = 0.5f * mass * (cumulativeForce(p)[3] + gravity * mass);
+		const float inf = std::numeric_limits<float>::infinity();
+
+		Halide::Func partials;
+		partials(b) = Halide::Tuple(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, inf, inf, -inf, -inf);
+		partials(b) = Halide::Tuple(partials(b)[0] + Halide::select(valid, kinetic, 0.0f),
+									partials(b)[1] + Halide::select(valid, potential, 0.0f),
+									partials(b)[2] + Halide::select(valid, mass * input(p, 3), 0.0f),
+									partials(b)[3] + Halide::select(valid, mass * input(p, 4), 0.0f),
+									partials(b)[4] + Halide::select(valid, mass * input(p, 5), 0.0f),
+									Halide::min(partials(b)[5], Halide::select(valid, input(p, 0), inf)),
+									Halide::min(partials(b)[6], Halide::select(valid, input(p, 1), inf)),
+									Halide::max(partials(b)[7], Halide::select(valid, input(p, 0), -inf)),
+									Halide::max(partials(b)[8], Halide::select(valid, input(p, 1), -inf)));
+		*telemetry = TelemetryColumns(partials, GRAVITY_TELEMETRY_COUNT);
+	}
+
+	return updated;
+}
+
+// Ensemble version of Gravity. input(i, plane, m) holds M independent systems of the same size,
+// and gravity(m) is the gravitational constant of system m. All systems are stepped in one
+// realize, in parallel over m, so many small systems can fill the machine together.
+template <typename INPUT, typename PARAMS>
+Halide::Func GravityEnsemble(INPUT input, PARAMS gravity, MathPrecision precision = PRECISION_EXACT,
+							 const ScheduleParams& schedule = CurrentSchedule()) {
+	Halide::Var i, m;
+
+	Halide::RDom j(0, input.width());
+
+	Vec x0(input(i, 0, m), input(i, 1, m), input(i, 2, m));
+	Vec x1(input(j, 0, m), input(j, 1, m), input(j, 2, m));
+	Vec a = GravitationalAcceleration(x0, x1, input(j, 6, m), gravity(m), precision);
+
+	Halide::Func cumulativeForce;
+	cumulativeForce(i, m) = Halide::Tuple(Halide::sum(a.x), Halide::sum(a.y), Halide::sum(a.z));
+
+	cumulativeForce.vectorize(i, schedule.vectorWidth).parallel(m);
+	cumulativeForce.compute_root();
+
+	Halide::Func updated;
+	Halide::Var k;
+	updated(i, k, m) = 0.0f;
+	updated(i, 0, m) = input(i, 0, m) + input(i, 3, m);
+	updated(i, 1, m) = input(i, 1, m) + input(i, 4, m);
+	updated(i, 2, m) = input(i, 2, m) + input(i, 5, m);
+	updated(i, 3, m) = input(i, 3, m) + cumulativeForce(i, m)[0];
+	updated(i, 4, m) = input(i, 4, m) + cumulativeForce(i, m)[1];
+	updated(i, 5, m) = input(i, 5, m) + cumulativeForce(i, m)[2];
+	updated(i, 6, m) = input(i, 6, m);
+
+	updated.parallel(m);
+	for (int up = 0; up < 6; ++up) {
+		updated.update(up).vectorize(i, schedule.vectorWidth).parallel(m);
+	}
+
+	return updated;
+}
+
+}
+
+#endif // HalideExamples_Gravity_h
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "ImplicitSpringMesh.h"
+#include "SpringMesh.h"
+#include "ThreadPool.h"
+
+using namespace Halide;
+
+namespace HalideExamples {
+
+namespace {
+
+// Product of one spring's force Jacobian with the direction field q: the change in force on
+// (x, y) when it and its neighbour at (x + dx, y + dy) move by q. Along the spring the stiffness
+// is springForce; across it, springForce * (1 - restLength / len), clamped at zero.
+Vec SpringJacobianProduct(Func pos, Func q, Expr width, Expr height, Var x, Var y, int dx, int dy,
+						  Expr restLength, Expr springForce) {
+	Expr x1 = clamp(x + dx, 0, width - 1);
+	Expr y1 = clamp(y + dy, 0, height - 1);
+	Expr exists = x1 == x + dx && y1 == y + dy;
+
+	Expr ddx = pos(x1, y1, 0) - pos(x, y, 0);
+	Expr ddy = pos(x1, y1, 1) - pos(x, y, 1);
+	Expr len = Halide::sqrt(ddx * ddx + ddy * ddy);
+	Expr ux = ddx / len;
+	Expr uy = ddy / len;
+	Expr transverse = Halide::max(0.0f, 1.0f - restLength / len);
+
+	Expr qx = q(x1, y1, 0) - q(x, y, 0);
+	Expr qy = q(x1, y1, 1) - q(x, y, 1);
+	Expr along = ux * qx + uy * qy;
+	Expr kx = springForce * (ux * along + transverse * (qx - ux * along));
+	Expr ky = springForce * (uy * along + transverse * (qy - uy * along));
+	return Vec(select(exists, kx, 0.0f), select(exists, ky, 0.0f), 0);
+}
+
+Vec MeshJacobianProduct(Func pos, Func q, Expr width, Expr height, Var x, Var y, Expr restLength, Expr springForce) {
+	const float ROOT2 = 1.4142135623f;
+	Expr diagonal = ROOT2 * restLength;
+	return SpringJacobianProduct(pos, q, width, height, x, y,  0, -1, restLength, springForce)
+		 + SpringJacobianProduct(pos, q, width, height, x, y, -1,  0, restLength, springForce)
+		 + SpringJacobianProduct(pos, q, width, height, x, y,  1,  0, restLength, springForce)
+		 + SpringJacobianProduct(pos, q, width, height, x, y,  0,  1, restLength, springForce)
+		 + SpringJacobianProduct(pos, q, width, height, x, y, -1, -1, diagonal, springForce)
+		 + SpringJacobianProduct(pos, q, width, height, x, y, -1,  1, diagonal, springForce)
+		 + SpringJacobianProduct(pos, q, width, height, x, y,  1, -1, diagonal, springForce)
+		 + SpringJacobianProduct(pos, q, width, height, x, y,  1,  1, diagonal, springForce);
+}
+
+}
+
+ImplicitSpringMesh::ImplicitSpringMesh(int width, int height, float springForce, float restLength, float gravity, float timestep)
+	: width(width)
+	, height(height)
+	, tolerance(1e-4f)
+	, maxIterations(50)
+	, meshParam(type_of<float>(), 3)
+	, directionParam(type_of<float>(), 3)
+	, dotA(type_of<float>(), 3)
+	, dotB(type_of<float>(), 3)
+	, b(width, height, 3)
+	, v(width, height, 2)
+	, r(width, height, 2)
+	, p(width, height, 2)
+	, ap(width, height, 2)
+	, rowSums(height)
+{
+	springForceParam.set(springForce);
+	restLengthParam.set(restLength);
+	gravityParam.set(gravity);
+	timestepParam.set(timestep);
+
+	Var x, y, c, m;
+	Expr h = timestepParam;
+
+	// View the mesh as instance 0 of an ensemble, for the shared force code
+	Func state;
+	state(x, y, c, m) = meshParam(x, y, c);
+	Func pos;
+	pos(x, y, c) = meshParam(x, y, c);
+
+	// Right-hand side: v + h (f(x) + g). Component 2 is each point's share of its springs' energy,
+	// from the same spring lengths as the force, for the telemetry.
+	Func force;
+	Expr energy;
+	Vec f = MeshSpringForce(state, meshParam.width(), meshParam.height(), x, y, 0, restLengthParam, springForceParam,
+							PRECISION_EXACT, &energy);
+	force(x, y) = Tuple(f.x, f.y + gravityParam, energy);
+	rhs(x, y, c) = select(c == 2, force(x, y)[2],
+						  meshParam(x, y, 2 + min(c, 1)) + h * select(c == 0, force(x, y)[0], force(x, y)[1]));
+
+	// System matrix: (I - h^2 J) q
+	Func q;
+	q(x, y, c) = directionParam(x, y, c);
+	Func jq;
+	Vec product = MeshJacobianProduct(pos, q, meshParam.width(), meshParam.height(), x, y, restLengthParam, springForceParam);
+	jq(x, y) = Tuple(product.x, product.y);
+	system(x, y, c) = directionParam(x, y, c) - h * h * select(c == 0, jq(x, y)[0], jq(x, y)[1]);
+
+	// Dot products are summed per row in parallel, then across rows in C++
+	RDom e(0, width, 0, 2);
+	rowDots(y) = sum(dotA(e.x, y, e.y) * dotB(e.x, y, e.y));
+
+	// Compute all components of each point together, with rows in parallel
+	Func stages[] = { rhs, system };
+	Func producers[] = { force, jq };
+	const int components[] = { 3, 2 };
+	for (int i = 0; i < 2; ++i) {
+		stages[i].bound(c, 0, components[i])
+			.reorder(c, x, y)
+			.unroll(c)
+			.vectorize(x, 8)
+			.parallel(y);
+		producers[i].compute_at(stages[i], y)
+			.vectorize(x, 8);
+		UseThreadPool(stages[i]);
+	}
+	rowDots.parallel(y);
+	UseThreadPool(rowDots);
+}
+
+void ImplicitSpringMesh::setTolerance(float tolerance) {
+	this->tolerance = tolerance;
+}
+
+void ImplicitSpringMesh::setMaxIterations(int maxIterations) {
+	this->maxIterations = maxIterations;
+}
+
+void ImplicitSpringMesh::applySystem(Image<float>& direction, Image<float>& result) {
+	directionParam.set(direction);
+	system.realize(result);
+}
+
+double ImplicitSpringMesh::dot(Image<float>& u, Image<float>& w) {
+	dotA.set(u);
+	dotB.set(w);
+	rowDots.realize(rowSums);
+	double total = 0.0;
+	for (int y = 0; y < height; ++y) {
+		total += rowSums(y);
+	}
+	return total;
+}
+
+ImplicitSpringMesh::SolveStats ImplicitSpringMesh::step(Image<float>& mesh, Image<float>* telemetry) {
+	const int n = width * height * 2;
+	meshParam.set(mesh);
+	rhs.realize(b);
+
+	// Start from the current velocities, which are close to the answer for small steps
+	float* vd = v.data();
+	float* rd = r.data();
+	float* pd = p.data();
+	float* apd = ap.data();
+	const float* bd = b.data();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			v(x, y, 0) = mesh(x, y, 2);
+			v(x, y, 1) = mesh(x, y, 3);
+		}
+	}
+	applySystem(v, ap);
+	for (int i = 0; i < n; ++i) {
+		rd[i] = bd[i] - apd[i];
+		pd[i] = rd[i];
+	}
+
+	double bb = dot(b, b);
+	double rr = dot(r, r);
+	double threshold = static_cast<double>(tolerance) * tolerance * bb;
+
+	SolveStats stats;
+	stats.iterations = 0;
+	ThreadPool& pool = ThreadPool::shared();
+	while (stats.iterations < maxIterations && rr > threshold) {
+		applySystem(p, ap);
+		double alpha = rr / dot(p, ap);
+		pool.parallelFor(0, height, [&](int y) {
+			for (int i = y * width; i < (y + 1) * width; ++i) {
+				for (int c = 0; c < 2; ++c) {
+					int k = i + c * width * height;
+					vd[k] += static_cast<float>(alpha) * pd[k];
+					rd[k] -= static_cast<float>(alpha) * apd[k];
+				}
+			}
+			return 0;
+		});
+		double rrNew = dot(r, r);
+		double beta = rrNew / rr;
+		rr = rrNew;
+		pool.parallelFor(0, height, [&](int y) {
+			for (int i = y * width; i < (y + 1) * width; ++i) {
+				for (int c = 0; c < 2; ++c) {
+					int k = i + c * width * height;
+					pd[k] = rd[k] + static_cast<float>(beta) * pd[k];
+				}
+			}
+			return 0;
+		});
+		++stats.iterations;
+	}
+	stats.residual = bb > 0.0 ? static_cast<float>(std::sqrt(rr / bb)) : 0.0f;
+
+	// Move the mesh with the new velocities, accumulating the telemetry of the state it leaves on
+	// the way
+	float h = timestepParam.get();
+	pool.parallelFor(0, height, [&](int y) {
+		const float inf = std::numeric_limits<float>::infinity();
+		float partials[SPRING_MESH_TELEMETRY_COUNT] = { 0.0f, 0.0f, 0.0f, 0.0f, inf, inf, -inf, -inf };
+		for (int x = 0; x < width; ++x) {
+			float px = mesh(x, y, 0);
+			float py = mesh(x, y, 1);
+			float vx = mesh(x, y, 2);
+			float vy = mesh(x, y, 3);
+			partials[0] += 0.5f * (vx * vx + vy * vy);
+			partials[1] += b(x, y, 2);
+			partials[2] += vx;
+			partials[3] += vy;
+			partials[4] = std::min(partials[4], px);
+			partials[5] = std::min(partials[5], py);
+			partials[6] = std::max(partials[6], px);
+			partials[7] = std::max(partials[7], py);
+
+			mesh(x, y, 2) = v(x, y, 0);
+			mesh(x, y, 3) = v(x, y, 1);
+			mesh(x, y, 0) = px + h * v(x, y, 0);
+			mesh(x, y, 1) = py + h * v(x, y, 1);
+		}
+		if (telemetry) {
+			for (int q = 0; q < SPRING_MESH_TELEMETRY_COUNT; ++q) {
+				(*telemetry)(y, q) = partials[q];
+			}
+		}
+		return 0;
+	});
+
+	return stats;
+}
+
+}
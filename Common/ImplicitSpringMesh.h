@@ -0,0 +1,67 @@
+#ifndef HalideExamples_ImplicitSpringMesh_h
+#define HalideExamples_ImplicitSpringMesh_h
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// Backward-Euler integrator for the 8-neighbour spring mesh of SpringMesh.h.
+//
+// Each step solves (I - h^2 J) v' = v + h (f(x) + g) for the new velocities v' and then moves the
+// mesh by h v', where h is the timestep in units of SpringMesh's explicit step and J is the
+// Jacobian of the spring forces. The system is solved with conjugate gradients; J is never
+// assembled, its product with a vector is a Halide stencil over the same 8 neighbours as the
+// force. The transverse part of each spring's stiffness is clamped at zero for compressed springs
+// so the system stays positive definite, which keeps large steps stable.
+class ImplicitSpringMesh {
+public:
+	struct SolveStats {
+		int iterations;
+		float residual;		// final residual norm relative to the right-hand side
+	};
+
+	ImplicitSpringMesh(int width, int height, float springForce, float restLength, float gravity, float timestep);
+
+	// Advance a width x height x 4 mesh by one timestep, in place. If telemetry is given, it
+	// receives the per-row partials of the mesh before the step, laid out as the telemetry of
+	// SpringMesh (height x SPRING_MESH_TELEMETRY_COUNT). They are accumulated in the loop that moves
+	// the mesh, with the spring energy from the force evaluation of the right-hand side.
+	SolveStats step(Halide::Image<float>& mesh, Halide::Image<float>* telemetry = 0);
+
+	void setTolerance(float tolerance);
+	void setMaxIterations(int maxIterations);
+
+private:
+	void applySystem(Halide::Image<float>& direction, Halide::Image<float>& result);
+	double dot(Halide::Image<float>& u, Halide::Image<float>& w);
+
+	int width;
+	int height;
+	float tolerance;
+	int maxIterations;
+
+	Halide::ImageParam meshParam;
+	Halide::ImageParam directionParam;
+	Halide::ImageParam dotA;
+	Halide::ImageParam dotB;
+	Halide::Param<float> springForceParam;
+	Halide::Param<float> restLengthParam;
+	Halide::Param<float> gravityParam;
+	Halide::Param<float> timestepParam;
+
+	Halide::Func rhs;
+	Halide::Func system;
+	Halide::Func rowDots;
+
+	// CG vectors, each width x height x 2. b has a third plane for the spring energy of each point.
+	Halide::Image<float> b;
+	Halide::Image<float> v;
+	Halide::Image<float> r;
+	Halide::Image<float> p;
+	Halide::Image<float> ap;
+	Halide::Image<float> rowSums;
+};
+
+}
+
+#endif // HalideExamples_ImplicitSpringMesh_h
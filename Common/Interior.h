@@ -0,0 +1,55 @@
+#ifndef HalideExamples_Interior_h
+#define HalideExamples_Interior_h
+
+#include <vector>
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// Stencils are only valid away from the edges of their input, so the demos and tests realize them
+// over the interior of a buffer, leaving a border of the given width untouched. This goes behind
+// Halide's back and temporarily shrinks the buffer's first two dimensions.
+
+inline void ShrinkToInterior(Halide::Buffer& buffer, int border) {
+	buffer_t* rawbuf = buffer.raw_buffer();
+	rawbuf->extent[0] -= 2 * border;
+	rawbuf->extent[1] -= 2 * border;
+	rawbuf->min[0] = border;
+	rawbuf->min[1] = border;
+	rawbuf->host += border * rawbuf->elem_size * (rawbuf->stride[0] + rawbuf->stride[1]);
+}
+
+inline void RestoreFromInterior(Halide::Buffer& buffer, int border) {
+	buffer_t* rawbuf = buffer.raw_buffer();
+	rawbuf->extent[0] += 2 * border;
+	rawbuf->extent[1] += 2 * border;
+	rawbuf->min[0] = 0;
+	rawbuf->min[1] = 0;
+	rawbuf->host -= border * rawbuf->elem_size * (rawbuf->stride[0] + rawbuf->stride[1]);
+}
+
+// Realize f over the interior of buffer. Pass the target f was compiled for, or it is compiled
+// again for the default JIT target.
+inline void RealizeInterior(Halide::Func& f, Halide::Buffer& buffer, int border,
+							const Halide::Target& target = Halide::get_jit_target_from_environment()) {
+	ShrinkToInterior(buffer, border);
+	f.realize(buffer, target);
+	RestoreFromInterior(buffer, border);
+}
+
+// Realize a Tuple-valued f over the interior of each of its output buffers
+inline void RealizeInterior(Halide::Func& f, std::vector<Halide::Buffer>& buffers, int border,
+							const Halide::Target& target = Halide::get_jit_target_from_environment()) {
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		ShrinkToInterior(buffers[i], border);
+	}
+	f.realize(Halide::Realization(buffers), target);
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		RestoreFromInterior(buffers[i], border);
+	}
+}
+
+}
+
+#endif // HalideExamples_Interior_h
@@ -0,0 +1,184 @@
+#ifndef HalideExamples_ParticleFountain_h
+#define HalideExamples_ParticleFountain_h
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+/////////////////// PARTICLE FOUNTAIN FUNCTION ////////////////////
+
+// Particle state is stored as PARTICLE_PLANES planes: position x, y, velocity x, y and the
+// number of steps the particle has left to live.
+const int PARTICLE_PLANES = 5;
+
+// Step the particles. The output is a Tuple of the 5 new state planes followed by a uint8 alive
+// mask, which is 0 for particles whose life has run out or that have left the width x height
+// screen. Dead particles are removed by compacting the state with this mask. Realize it over at
+// least 1024 particles.
+template <typename F1>
+Halide::Func ParticleFountain(F1 particles, Halide::Expr gravity, Halide::Expr width, Halide::Expr height) {
+	////////////////////////// ALGORITHM //////////////////////////
+
+	Halide::Func output;
+	Halide::Var x, xo, xi;
+
+	// adjust Y velocity
+	Halide::Expr vely = particles(x, 3) + gravity;
+	// move the particle
+	Halide::Expr newx = particles(x, 0) + particles(x, 2);
+	Halide::Expr newy = particles(x, 1) + vely;
+	Halide::Expr life = particles(x, 4) - 1.0f;
+	Halide::Expr alive = life > 0.0f && newx >= 0.0f && newx < width && newy < height;
+	output(x) = Halide::Tuple(newx,
+							  newy,
+							  particles(x, 2),
+							  vely,
+							  life,
+							  Halide::cast<uint8_t>(Halide::select(alive, 1, 0)));
+
+	////////////////////////// SCHEDULE //////////////////////////
+
+	// Blocks of particles in parallel, vectorized within each block
+	output.split(x, xo, xi, 1024)
+		.parallel(xo)
+		.vectorize(xi, 32);
+
+	return output;
+}
+
+// Uniform random number in [0, 1) from a hash of the particle index, the seed and a stream number,
+// so new particles can be generated in vectorized Halide code instead of with std::rand
+inline Halide::Expr HashRandom(Halide::Expr i, Halide::Expr seed, int stream) {
+	Halide::Expr h = Halide::cast<uint32_t>(i) * Halide::cast<uint32_t>(0x9E3779B1u)
+				   + Halide::cast<uint32_t>(seed) * Halide::cast<uint32_t>(0x85EBCA77u)
+				   + Halide::cast<uint32_t>(stream) * Halide::cast<uint32_t>(0xC2B2AE3Du);
+	Halide::Expr s8 = Halide::cast<uint32_t>(8);
+	Halide::Expr s15 = Halide::cast<uint32_t>(15);
+	Halide::Expr s16 = Halide::cast<uint32_t>(16);
+	h = h ^ (h >> s16);
+	h = h * Halide::cast<uint32_t>(0x7FEB352Du);
+	h = h ^ (h >> s15);
+	h = h * Halide::cast<uint32_t>(0x846CA68Bu);
+	h = h ^ (h >> s16);
+	return Halide::cast<float>(h >> s8) * (1.0f / 16777216.0f);
+}
+
+inline Halide::Expr HashRandom(Halide::Expr i, Halide::Expr seed, int stream, Halide::Expr min, Halide::Expr max) {
+	return HashRandom(i, seed, stream) * (max - min) + min;
+}
+
+// Create new particles. The output has the same planes as the particle state; realize it over
+// the free slots at the end of the live particles, in multiples of 8. The particles get launched
+// upward with random directions and speeds from (originX, originY), and live for minLife to
+// maxLife steps.
+inline Halide::Func ParticleEmitter(Halide::Expr seed, Halide::Expr originX, Halide::Expr originY,
+									Halide::Expr timescale, Halide::Expr minLife, Halide::Expr maxLife) {
+	const float PI = 3.14159265358979f;
+
+	Halide::Func emitted;
+	Halide::Var x;
+
+	Halide::Expr vel = timescale * (HashRandom(x, seed, 0, 10.0f, 100.0f)
+								  + HashRandom(x, seed, 1, 10.0f, 100.0f)
+								  + HashRandom(x, seed, 2, 10.0f, 100.0f));
+	Halide::Expr angle = HashRandom(x, seed, 3, PI / 4.0f, 3.0f * PI / 4.0f);
+	emitted(x) = Halide::Tuple(Halide::cast<float>(originX),
+							   Halide::cast<float>(originY),
+							   vel * Halide::cos(angle),
+							   -vel * Halide::sin(angle), // negative direction to go upward
+							   Halide::floor(HashRandom(x, seed, 4, minLife, maxLife)));
+
+	emitted.vectorize(x, 8);
+
+	return emitted;
+}
+
+// Cell of a particle in a uniform grid of gridWidth x gridHeight square cells of the given size.
+// Particles outside the grid are clamped to its edge cells.
+inline Halide::Expr ParticleCell(Halide::Expr x, Halide::Expr y, Halide::Expr cellSize,
+								 Halide::Expr gridWidth, Halide::Expr gridHeight) {
+	Halide::Expr cx = Halide::clamp(Halide::cast<int>(Halide::floor(x / cellSize)), 0, gridWidth - 1);
+	Halide::Expr cy = Halide::clamp(Halide::cast<int>(Halide::floor(y / cellSize)), 0, gridHeight - 1);
+	return cx + gridWidth * cy;
+}
+
+// Cell key of every particle, for sorting the particles into a SpatialGrid. Realize it over a
+// multiple of 1024 particles.
+template <typename F1>
+Halide::Func ParticleCellKeys(F1 particles, Halide::Expr cellSize, Halide::Expr gridWidth, Halide::Expr gridHeight) {
+	Halide::Func keys;
+	Halide::Var i, io, ii;
+	keys(i) = ParticleCell(particles(i, 0), particles(i, 1), cellSize, gridWidth, gridHeight);
+
+	keys.split(i, io, ii, 1024)
+		.parallel(io)
+		.vectorize(ii, 8);
+
+	return keys;
+}
+
+// Most particles of each cell that take part in collisions, which bounds the cost of a step. The
+// rest of a crowded cell, such as the one at the fountain's source, neither push nor are pushed.
+const int MAX_PARTICLES_PER_CELL = 8;
+
+// Short-range repulsion between particles that have been sorted by cell. sorted holds the
+// particle planes in cell order and cellStarts the matching SpatialGrid::cellStarts(). Each
+// particle only looks at the particles in its own and the 8 adjacent cells, so the cellSize must
+// be at least the interaction distance. Particles closer than distance are pushed apart with a
+// velocity change proportional to their overlap. Only the first MAX_PARTICLES_PER_CELL particles of
+// each cell take part, on both sides of a pair, so every push has an equal and opposite one and
+// momentum is conserved. The output has the same planes as the input;
+// realize it over a multiple of 1024 particles.
+template <typename F1, typename F2>
+Halide::Func ParticleCollisions(F1 sorted, F2 cellStarts, Halide::Expr cellSize, Halide::Expr gridWidth, Halide::Expr gridHeight,
+								Halide::Expr distance, Halide::Expr stiffness) {
+	Halide::Var i, io, ii;
+
+	Halide::Expr px = sorted(i, 0);
+	Halide::Expr py = sorted(i, 1);
+	Halide::Expr cx = Halide::clamp(Halide::cast<int>(Halide::floor(px / cellSize)), 0, gridWidth - 1);
+	Halide::Expr cy = Halide::clamp(Halide::cast<int>(Halide::floor(py / cellSize)), 0, gridHeight - 1);
+
+	// A particle past the cap of its own cell is never seen by its neighbours, so it mustn't see them
+	Halide::Expr counted = i - cellStarts(cx + gridWidth * cy) < MAX_PARTICLES_PER_CELL;
+
+	// Walk up to MAX_PARTICLES_PER_CELL particles in each of the 3x3 neighbouring cells
+	Halide::RDom r(-1, 3, -1, 3, 0, MAX_PARTICLES_PER_CELL);
+	Halide::Expr nx = cx + r.x;
+	Halide::Expr ny = cy + r.y;
+	Halide::Expr cell = Halide::clamp(nx, 0, gridWidth - 1) + gridWidth * Halide::clamp(ny, 0, gridHeight - 1);
+	Halide::Expr j = cellStarts(cell) + r.z;
+	Halide::Expr valid = counted && nx >= 0 && nx < gridWidth && ny >= 0 && ny < gridHeight && j < cellStarts(cell + 1) && j != i;
+	Halide::Expr jc = Halide::clamp(j, 0, sorted.width() - 1);
+
+	Halide::Expr dx = px - sorted(jc, 0);
+	Halide::Expr dy = py - sorted(jc, 1);
+	Halide::Expr d2 = dx * dx + dy * dy;
+	Halide::Expr d = Halide::sqrt(Halide::max(d2, 1e-6f));
+	Halide::Expr push = Halide::select(valid && d2 < distance * distance, stiffness * (distance - d) / d, 0.0f);
+
+	Halide::Func impulse;
+	impulse(i) = Halide::Tuple(0.0f, 0.0f);
+	impulse(i) = Halide::Tuple(impulse(i)[0] + push * dx, impulse(i)[1] + push * dy);
+
+	Halide::Func output;
+	output(i) = Halide::Tuple(px,
+							  py,
+							  sorted(i, 2) + impulse(i)[0],
+							  sorted(i, 3) + impulse(i)[1],
+							  sorted(i, 4));
+
+	output.split(i, io, ii, 1024)
+		.parallel(io)
+		.vectorize(ii, 8);
+	impulse.compute_at(output, io)
+		.vectorize(i, 8);
+	impulse.update()
+		.vectorize(i, 8);
+
+	return output;
+}
+
+}
+
+#endif // HalideExamples_ParticleFountain_h
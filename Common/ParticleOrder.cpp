@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "ParticleOrder.h"
+#include "ThreadPool.h"
+
+namespace HalideExamples {
+
+namespace {
+
+// Particles per block of the sort and the gather, radix digit size, and key realization granule
+const int SORT_BLOCK = 4096;
+const int RADIX_BITS = 8;
+const int RADIX = 1 << RADIX_BITS;
+const int KEY_GRANULE = 256;
+
+const float* Plane(Halide::Buffer& state, int plane) {
+	buffer_t* raw = state.raw_buffer();
+	return reinterpret_cast<const float*>(raw->host) + raw->stride[1] * plane;
+}
+
+float* MutablePlane(Halide::Buffer& state, int plane) {
+	buffer_t* raw = state.raw_buffer();
+	return reinterpret_cast<float*>(raw->host) + raw->stride[1] * plane;
+}
+
+}
+
+ParticleOrder::ParticleOrder(int count, int planes, SpaceFillingCurve curve)
+	: count(count)
+	, planes(planes)
+	, threshold(1.5)
+	, sortedLocality(0.0)
+	, reorderCount(0)
+	, input(Halide::type_of<float>(), 2)
+	, keyImage((count + KEY_GRANULE - 1) / KEY_GRANULE * KEY_GRANULE)
+	, sortedKeys(count)
+	, keysScratch(count)
+	, order(count)
+	, orderScratch(count)
+	, ids(count)
+	, idsScratch(count)
+{
+	for (int i = 0; i < count; ++i) {
+		ids[i] = i;
+	}
+
+	// The keys are realized over whole granules; the padding repeats the last particle
+	Halide::Func clamped;
+	Halide::Var i, p;
+	clamped(i, p) = input(Halide::min(i, input.width() - 1), p);
+	keyFunc = CurveKeys(clamped, minX, minY, scale, curve);
+	UseThreadPool(keyFunc);
+}
+
+void ParticleOrder::setThreshold(double threshold) {
+	this->threshold = threshold;
+}
+
+const std::vector<int32_t>& ParticleOrder::identity() const {
+	return ids;
+}
+
+const Halide::Image<uint32_t>& ParticleOrder::keys() const {
+	return keyImage;
+}
+
+int ParticleOrder::reorders() const {
+	return reorderCount;
+}
+
+ParticleOrder::Extent ParticleOrder::measure(Halide::Buffer& state) {
+	ThreadPool& pool = ThreadPool::shared();
+	const float* x = Plane(state, 0);
+	const float* y = Plane(state, 1);
+	int blocks = (count + SORT_BLOCK - 1) / SORT_BLOCK;
+	std::vector<Extent> partials(blocks);
+	pool.parallelFor(0, blocks, [&](int b) {
+		Extent e;
+		e.minX = e.minY = std::numeric_limits<float>::infinity();
+		e.maxX = e.maxY = -std::numeric_limits<float>::infinity();
+		e.gaps = 0.0;
+		int end = std::min(count, (b + 1) * SORT_BLOCK);
+		for (int i = b * SORT_BLOCK; i < end; ++i) {
+			e.minX = std::min(e.minX, x[i]);
+			e.minY = std::min(e.minY, y[i]);
+			e.maxX = std::max(e.maxX, x[i]);
+			e.maxY = std::max(e.maxY, y[i]);
+			if (i + 1 < count) {
+				double dx = x[i + 1] - x[i];
+				double dy = y[i + 1] - y[i];
+				e.gaps += std::sqrt(dx * dx + dy * dy);
+			}
+		}
+		partials[b] = e;
+		return 0;
+	});
+
+	Extent total = partials[0];
+	for (int b = 1; b < blocks; ++b) {
+		total.minX = std::min(total.minX, partials[b].minX);
+		total.minY = std::min(total.minY, partials[b].minY);
+		total.maxX = std::max(total.maxX, partials[b].maxX);
+		total.maxY = std::max(total.maxY, partials[b].maxY);
+		total.gaps += partials[b].gaps;
+	}
+	return total;
+}
+
+double ParticleOrder::locality(Halide::Buffer& state) {
+	if (count < 2) {
+		return 0.0;
+	}
+	Extent e = measure(state);
+	double width = std::max(1e-6, static_cast<double>(e.maxX - e.minX));
+	double height = std::max(1e-6, static_cast<double>(e.maxY - e.minY));
+	double spacing = std::sqrt(width * height / count);
+	return e.gaps / (count - 1) / spacing;
+}
+
+bool ParticleOrder::update(Halide::Buffer& state, Halide::Buffer& scratch) {
+	if (reorderCount > 0 && locality(state) <= threshold * sortedLocality) {
+		return false;
+	}
+	reorder(state, scratch);
+	return true;
+}
+
+void ParticleOrder::reorder(Halide::Buffer& state, Halide::Buffer& scratch) {
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Quantize over the square around the bounding box, so both axes have the same resolution
+	Extent e = measure(state);
+	float range = std::max(std::max(e.maxX - e.minX, e.maxY - e.minY), 1e-6f);
+	minX.set(e.minX);
+	minY.set(e.minY);
+	scale.set(((1 << CURVE_BITS) - 1) / range);
+	input.set(state);
+	keyFunc.realize(keyImage);
+
+	const uint32_t* keyData = keyImage.data();
+	std::copy(keyData, keyData + count, sortedKeys.begin());
+	for (int i = 0; i < count; ++i) {
+		order[i] = i;
+	}
+	sortKeys();
+
+	// Gather every plane, and the identities, into sorted order
+	int blocks = (count + SORT_BLOCK - 1) / SORT_BLOCK;
+	pool.parallelFor(0, (planes + 1) * blocks, [&](int task) {
+		int p = task / blocks;
+		int begin = (task % blocks) * SORT_BLOCK;
+		int end = std::min(count, begin + SORT_BLOCK);
+		if (p == planes) {
+			for (int i = begin; i < end; ++i) {
+				idsScratch[i] = ids[order[i]];
+			}
+		} else {
+			const float* in = Plane(state, p);
+			float* out = MutablePlane(scratch, p);
+			for (int i = begin; i < end; ++i) {
+				out[i] = in[order[i]];
+			}
+		}
+		return 0;
+	});
+	ids.swap(idsScratch);
+	std::swap(*state.raw_buffer(), *scratch.raw_buffer());
+
+	sortedLocality = locality(state);
+	++reorderCount;
+}
+
+// Stable LSD radix sort of sortedKeys, carrying the source index of each key in order. Each pass
+// histograms the digit per block, scans over (digit, block), and scatters each block in order.
+void ParticleOrder::sortKeys() {
+	ThreadPool& pool = ThreadPool::shared();
+	int blocks = std::max(1, std::min(pool.threadCount(), (count + SORT_BLOCK - 1) / SORT_BLOCK));
+	histograms.resize(static_cast<size_t>(blocks) * RADIX);
+
+	for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+		pool.parallelFor(0, blocks, [&](int b) {
+			int32_t* histogram = &histograms[static_cast<size_t>(b) * RADIX];
+			std::fill(histogram, histogram + RADIX, 0);
+			int begin = static_cast<int>(static_cast<int64_t>(count) * b / blocks);
+			int end = static_cast<int>(static_cast<int64_t>(count) * (b + 1) / blocks);
+			for (int i = begin; i < end; ++i) {
+				++histogram[(sortedKeys[i] >> shift) & (RADIX - 1)];
+			}
+			return 0;
+		});
+
+		// A digit shared by every key leaves the order unchanged
+		bool uniform = false;
+		int32_t running = 0;
+		for (int d = 0; d < RADIX; ++d) {
+			int32_t digitTotal = 0;
+			for (int b = 0; b < blocks; ++b) {
+				int32_t& cursor = histograms[static_cast<size_t>(b) * RADIX + d];
+				int32_t n = cursor;
+				cursor = running;
+				running += n;
+				digitTotal += n;
+			}
+			uniform = uniform || digitTotal == count;
+		}
+		if (uniform) {
+			continue;
+		}
+
+		pool.parallelFor(0, blocks, [&](int b) {
+			int32_t* cursor = &histograms[static_cast<size_t>(b) * RADIX];
+			int begin = static_cast<int>(static_cast<int64_t>(count) * b / blocks);
+			int end = static_cast<int>(static_cast<int64_t>(count) * (b + 1) / blocks);
+			for (int i = begin; i < end; ++i) {
+				int32_t slot = cursor[(sortedKeys[i] >> shift) & (RADIX - 1)]++;
+				keysScratch[slot] = sortedKeys[i];
+				orderScratch[slot] = order[i];
+			}
+			return 0;
+		});
+		sortedKeys.swap(keysScratch);
+		order.swap(orderScratch);
+	}
+}
+
+}
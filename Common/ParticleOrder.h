@@ -0,0 +1,160 @@
+#ifndef HalideExamples_ParticleOrder_h
+#define HalideExamples_ParticleOrder_h
+
+#include <cstdint>
+#include <vector>
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// Space-filling curves for ordering particles by position in the plane
+enum SpaceFillingCurve {
+	CURVE_MORTON,
+	CURVE_HILBERT
+};
+
+// Bits of each coordinate in a curve key, so a key fits in 32 bits
+const int CURVE_BITS = 16;
+
+// Quantize a coordinate to [0, 2^CURVE_BITS), given the minimum and the scale of its range
+inline Halide::Expr CurveCoordinate(Halide::Expr v, Halide::Expr min, Halide::Expr scale) {
+	return Halide::cast<uint32_t>(Halide::clamp(Halide::cast<int>((v - min) * scale), 0, (1 << CURVE_BITS) - 1));
+}
+
+// Spread the low 16 bits of v to the even bits
+inline Halide::Expr MortonSpread(Halide::Expr v) {
+	v = (v | (v << Halide::cast<uint32_t>(8))) & Halide::cast<uint32_t>(0x00FF00FF);
+	v = (v | (v << Halide::cast<uint32_t>(4))) & Halide::cast<uint32_t>(0x0F0F0F0F);
+	v = (v | (v << Halide::cast<uint32_t>(2))) & Halide::cast<uint32_t>(0x33333333);
+	v = (v | (v << Halide::cast<uint32_t>(1))) & Halide::cast<uint32_t>(0x55555555);
+	return v;
+}
+
+inline Halide::Expr MortonKey(Halide::Expr cx, Halide::Expr cy) {
+	return MortonSpread(cx) | (MortonSpread(cy) << Halide::cast<uint32_t>(1));
+}
+
+// Curve key of every particle, from its x and y planes. Coordinates are quantized as
+// (x - minX) * scale. The Hilbert key is computed one level per update step, with the rotated
+// coordinates carried along, rather than unrolled into one expression. Realize it over a multiple
+// of 256 particles.
+template <typename F1>
+Halide::Func CurveKeys(F1 particles, Halide::Expr minX, Halide::Expr minY, Halide::Expr scale,
+					   SpaceFillingCurve curve = CURVE_HILBERT) {
+	Halide::Func keys;
+	Halide::Var i, io, ii;
+	Halide::Expr cx = CurveCoordinate(particles(i, 0), minX, scale);
+	Halide::Expr cy = CurveCoordinate(particles(i, 1), minY, scale);
+
+	if (curve == CURVE_MORTON) {
+		keys(i) = MortonKey(cx, cy);
+	} else {
+		Halide::Func hilbert;
+		Halide::RDom l(0, CURVE_BITS);
+		Halide::Expr zero = Halide::cast<uint32_t>(0);
+		Halide::Expr one = Halide::cast<uint32_t>(1);
+		Halide::Expr full = Halide::cast<uint32_t>((1 << CURVE_BITS) - 1);
+		hilbert(i) = Halide::Tuple(cx, cy, zero);
+
+		// Quadrant at this level, then rotate the coordinates into the quadrant's frame
+		Halide::Expr x = hilbert(i)[0];
+		Halide::Expr y = hilbert(i)[1];
+		Halide::Expr s = one << Halide::cast<uint32_t>(CURVE_BITS - 1 - l);
+		Halide::Expr rx = Halide::select((x & s) != zero, one, zero);
+		Halide::Expr ry = Halide::select((y & s) != zero, one, zero);
+		Halide::Expr flip = rx == one && ry == zero;
+		Halide::Expr fx = Halide::select(flip, x ^ full, x);
+		Halide::Expr fy = Halide::select(flip, y ^ full, y);
+		Halide::Expr transpose = ry == zero;
+		hilbert(i) = Halide::Tuple(Halide::select(transpose, fy, fx),
+								   Halide::select(transpose, fx, fy),
+								   hilbert(i)[2] + s * s * ((Halide::cast<uint32_t>(3) * rx) ^ ry));
+		keys(i) = hilbert(i)[2];
+
+		hilbert.compute_at(keys, io)
+			.vectorize(i, 8);
+		hilbert.update()
+			.reorder(i, l.x)
+			.vectorize(i, 8);
+	}
+
+	keys.split(i, io, ii, 256)
+		.parallel(io)
+		.vectorize(ii, 8);
+
+	return keys;
+}
+
+// Keeps the particles of a simulation stored in space-filling curve order, so particles that are
+// near each other in space are near each other in memory.
+//
+// The state is count x planes, with x and y in planes 0 and 1. reorder() computes the curve key of
+// every particle, sorts the keys with a parallel LSD radix sort, and gathers every plane into the
+// new order. identity() follows the particles through every reorder, so a particle can still be
+// found by its original index.
+//
+// locality() is the mean distance between particles adjacent in memory, relative to the mean
+// spacing of particles over their bounding box: about 1 just after a reorder, and growing toward
+// sqrt(count) / 2 as the order decays to random. update() reorders only when the locality has
+// grown past threshold times its value after the last reorder.
+class ParticleOrder {
+public:
+	ParticleOrder(int count, int planes, SpaceFillingCurve curve = CURVE_HILBERT);
+
+	double locality(Halide::Buffer& state);
+
+	// Sort state into curve order, using scratch (same shape) for the copy. The two are swapped,
+	// so state holds the sorted particles.
+	void reorder(Halide::Buffer& state, Halide::Buffer& scratch);
+
+	// Reorder if locality has degraded, and return whether it did
+	bool update(Halide::Buffer& state, Halide::Buffer& scratch);
+
+	void setThreshold(double threshold);
+
+	// Original index of the particle in each slot
+	const std::vector<int32_t>& identity() const;
+
+	// Curve keys from the last reorder, in the order of the particles before it
+	const Halide::Image<uint32_t>& keys() const;
+
+	int reorders() const;
+
+private:
+	struct Extent {
+		float minX;
+		float minY;
+		float maxX;
+		float maxY;
+		double gaps;	// sum of distances between particles adjacent in memory
+	};
+
+	Extent measure(Halide::Buffer& state);
+	void sortKeys();
+
+	int count;
+	int planes;
+	double threshold;
+	double sortedLocality;
+	int reorderCount;
+
+	Halide::ImageParam input;
+	Halide::Param<float> minX;
+	Halide::Param<float> minY;
+	Halide::Param<float> scale;
+	Halide::Func keyFunc;
+	Halide::Image<uint32_t> keyImage;
+
+	std::vector<uint32_t> sortedKeys;
+	std::vector<uint32_t> keysScratch;
+	std::vector<int32_t> order;
+	std::vector<int32_t> orderScratch;
+	std::vector<int32_t> histograms;
+	std::vector<int32_t> ids;
+	std::vector<int32_t> idsScratch;
+};
+
+}
+
+#endif // HalideExamples_ParticleOrder_h
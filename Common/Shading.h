@@ -0,0 +1,44 @@
+#ifndef HalideExamples_Shading_h
+#define HalideExamples_Shading_h
+
+#include <Halide.h>
+
+#include "Vec.h"
+
+namespace HalideExamples {
+
+// Diffuse plus specular shading of the height field height(x, y), normalized to 0..1, for a light
+// at (lx, ly, lz) and an eye at (ex, ey, ez). Reads height at (x, y) and its 4 neighbours, so it
+// can be computed alongside any stencil over the same field.
+inline Halide::Expr SpecularShade(Halide::Func height, Halide::Var x, Halide::Var y,
+								  Halide::Expr lx, Halide::Expr ly, Halide::Expr lz,
+								  Halide::Expr ex, Halide::Expr ey, Halide::Expr ez) {
+	// Compute the surface normal as the cross product of the tangent vectors along X and Y
+	Vec tangentX(1, 0, (height(x + 1, y) - height(x - 1, y)) / 2);
+	Vec tangentY(0, 1, (height(x, y + 1) - height(x, y - 1)) / 2);
+	Vec normal = cross(tangentX, tangentY).normalized();
+
+	// Compute the vector to the light source
+	Vec l = (Vec(lx, ly, lz) - Vec(x, y, height(x, y))).normalized();
+
+	// Compute the diffuse illumination as the dot product of light vector and normal vector
+	// (proportional to cos(a) between the two)
+	Halide::Expr diffuse = dot(l, normal);
+
+	// Now calculate specular reflection
+
+	// Reflect an eye ray about the normal
+	Vec eye = Vec(x - ex, y - ey, height(x, y) - ez).normalized();
+	Vec reflect = eye - 2 * dot(eye, normal) * normal;
+
+	// If the angle is "very close", i.e. the reflected ray intersects the spherical light source,
+	// add a highlight
+	Halide::Expr specular = Halide::select(dot(l, reflect) > 0.98f, 0.5f, 0);
+
+	// The result is the sum of diffuse and specular, normalized to 0..1 range
+	return (diffuse + specular) / 1.5f;
+}
+
+}
+
+#endif // HalideExamples_Shading_h
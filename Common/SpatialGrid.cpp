@@ -0,0 +1,121 @@
+#include <algorithm>
+
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+
+namespace HalideExamples {
+
+namespace {
+
+// Particles per histogram block, and cells per prefix-sum chunk
+const int SORT_BLOCK = 65536;
+const int CELL_CHUNK = 4096;
+
+}
+
+SpatialGrid::SpatialGrid(int gridWidth, int gridHeight)
+	: gridWidth(gridWidth)
+	, gridHeight(gridHeight)
+	, starts(gridWidth * gridHeight + 1)
+{
+}
+
+int SpatialGrid::width() const {
+	return gridWidth;
+}
+
+int SpatialGrid::height() const {
+	return gridHeight;
+}
+
+int SpatialGrid::cells() const {
+	return gridWidth * gridHeight;
+}
+
+Halide::Image<int32_t>& SpatialGrid::cellStarts() {
+	return starts;
+}
+
+const std::vector<int32_t>& SpatialGrid::slots() const {
+	return sortedSlots;
+}
+
+void SpatialGrid::sort(const int32_t* keys, const std::vector<const float*>& src, const std::vector<float*>& dst, int count) {
+	ThreadPool& pool = ThreadPool::shared();
+	int numCells = cells();
+	int blocks = std::max(1, std::min(pool.threadCount(), (count + SORT_BLOCK - 1) / SORT_BLOCK));
+	int chunks = (numCells + CELL_CHUNK - 1) / CELL_CHUNK;
+	histograms.resize(static_cast<size_t>(blocks) * numCells);
+	sortedSlots.resize(count);
+	int32_t* cellStart = starts.data();
+
+	// Histogram the keys of each block of particles
+	pool.parallelFor(0, blocks, [&](int b) {
+		int32_t* histogram = &histograms[static_cast<size_t>(b) * numCells];
+		std::fill(histogram, histogram + numCells, 0);
+		int begin = static_cast<int>(static_cast<int64_t>(count) * b / blocks);
+		int end = static_cast<int>(static_cast<int64_t>(count) * (b + 1) / blocks);
+		for (int i = begin; i < end; ++i) {
+			++histogram[keys[i]];
+		}
+		return 0;
+	});
+
+	// Prefix sum over (cell, block), in two levels: totals per chunk of cells, a scan of the chunk
+	// totals, then a scan within each chunk that turns the histograms into write cursors
+	std::vector<int32_t> chunkOffsets(chunks + 1, 0);
+	pool.parallelFor(0, chunks, [&](int k) {
+		int end = std::min(numCells, (k + 1) * CELL_CHUNK);
+		int32_t total = 0;
+		for (int c = k * CELL_CHUNK; c < end; ++c) {
+			for (int b = 0; b < blocks; ++b) {
+				total += histograms[static_cast<size_t>(b) * numCells + c];
+			}
+		}
+		chunkOffsets[k + 1] = total;
+		return 0;
+	});
+	for (int k = 0; k < chunks; ++k) {
+		chunkOffsets[k + 1] += chunkOffsets[k];
+	}
+	pool.parallelFor(0, chunks, [&](int k) {
+		int end = std::min(numCells, (k + 1) * CELL_CHUNK);
+		int32_t running = chunkOffsets[k];
+		for (int c = k * CELL_CHUNK; c < end; ++c) {
+			cellStart[c] = running;
+			for (int b = 0; b < blocks; ++b) {
+				int32_t& cursor = histograms[static_cast<size_t>(b) * numCells + c];
+				int32_t n = cursor;
+				cursor = running;
+				running += n;
+			}
+		}
+		return 0;
+	});
+	cellStart[numCells] = count;
+
+	// Find every particle's sorted slot, then scatter the planes one at a time
+	pool.parallelFor(0, blocks, [&](int b) {
+		int32_t* cursor = &histograms[static_cast<size_t>(b) * numCells];
+		int begin = static_cast<int>(static_cast<int64_t>(count) * b / blocks);
+		int end = static_cast<int>(static_cast<int64_t>(count) * (b + 1) / blocks);
+		for (int i = begin; i < end; ++i) {
+			sortedSlots[i] = cursor[keys[i]]++;
+		}
+		return 0;
+	});
+	int scatterBlocks = (count + SORT_BLOCK - 1) / SORT_BLOCK;
+	pool.parallelFor(0, static_cast<int>(src.size()) * scatterBlocks, [&](int task) {
+		int p = task / scatterBlocks;
+		int begin = (task % scatterBlocks) * SORT_BLOCK;
+		int end = std::min(count, begin + SORT_BLOCK);
+		const float* in = src[p];
+		float* out = dst[p];
+		for (int i = begin; i < end; ++i) {
+			out[sortedSlots[i]] = in[i];
+		}
+		return 0;
+	});
+}
+
+}
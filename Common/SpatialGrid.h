@@ -0,0 +1,46 @@
+#ifndef HalideExamples_SpatialGrid_h
+#define HalideExamples_SpatialGrid_h
+
+#include <cstdint>
+#include <vector>
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// A uniform grid for neighbour searches over particles stored as planes (SoA).
+//
+// sort() takes the cell key of every particle and writes a copy of the particle planes ordered by
+// cell, so particles in the same cell are contiguous in memory. cellStarts(c) is the index of the
+// first sorted particle in cell c and cellStarts(c + 1) is one past the last, so a neighbour pass
+// only has to walk the particles of adjacent cells.
+//
+// The sort is a parallel counting sort: per-block cell histograms, a prefix sum over cells and
+// blocks, then a per-block scatter. It is stable, so equal input gives identical output.
+class SpatialGrid {
+public:
+	SpatialGrid(int gridWidth, int gridHeight);
+
+	int width() const;
+	int height() const;
+	int cells() const;
+
+	void sort(const int32_t* keys, const std::vector<const float*>& src, const std::vector<float*>& dst, int count);
+
+	// Per-cell start indices, with one extra entry holding the particle count
+	Halide::Image<int32_t>& cellStarts();
+
+	// Sorted position of each input particle, from the last sort
+	const std::vector<int32_t>& slots() const;
+
+private:
+	int gridWidth;
+	int gridHeight;
+	Halide::Image<int32_t> starts;
+	std::vector<int32_t> histograms;
+	std::vector<int32_t> sortedSlots;
+};
+
+}
+
+#endif // HalideExamples_SpatialGrid_h
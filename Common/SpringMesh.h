@@ -0,0 +1,183 @@
+#ifndef HalideExamples_SpringMesh_h
+#define HalideExamples_SpringMesh_h
+
+#include <limits>
+
+#include <Halide.h>
+
+#include "FastMath.h"
+#include "Telemetry.h"
+#include "Vec.h"
+
+namespace HalideExamples {
+
+// Mesh state is stored as 4 planes along the third dimension: position x, y and velocity x, y.
+
+// Force on a mass point at r0 from a spring connecting it to r1. If energy is given, it is set to
+// the energy stored in the spring, from the same length as the force.
+inline Vec SpringForce(const Vec& r0, const Vec& r1, Halide::Expr restLength, Halide::Expr springForce,
+					   MathPrecision precision = PRECISION_EXACT, Halide::Expr* energy = 0) {
+	Vec dr = r1 - r0;
+	if (precision == PRECISION_FAST) {
+		// k (len - rest) / len = k - k rest / len, with 1 / len from one reciprocal square root
+		Halide::Expr len2 = dr.magnitudeSquared();
+		Halide::Expr invLen = FastInverseSqrt(len2);
+		if (energy) {
+			Halide::Expr stretch = len2 * invLen - restLength;
+			*energy = 0.5f * springForce * stretch * stretch;
+		}
+		return (springForce - springForce * restLength * invLen) * dr;
+	}
+	Halide::Expr len = dr.magnitude();
+	if (energy) {
+		*energy = 0.5f * springForce * (len - restLength) * (len - restLength);
+	}
+	Halide::Expr f = (len - restLength) * springForce;
+	return f * dr / len;
+}
+
+// Force from the spring to the grid neighbour at (x + dx, y + dy) of instance m. Springs that
+// would cross the edge of the mesh don't exist and contribute nothing. energy is as for SpringForce.
+inline Vec GridSpringForce(Halide::Func state, Halide::Expr width, Halide::Expr height,
+						   Halide::Var x, Halide::Var y, Halide::Expr m, int dx, int dy,
+						   Halide::Expr restLength, Halide::Expr springForce,
+						   MathPrecision precision = PRECISION_EXACT, Halide::Expr* energy = 0) {
+	Vec r0(state(x, y, 0, m), state(x, y, 1, m), 0.0f);
+	Halide::Expr x1 = Halide::clamp(x + dx, 0, width - 1);
+	Halide::Expr y1 = Halide::clamp(y + dy, 0, height - 1);
+	Vec r1(state(x1, y1, 0, m), state(x1, y1, 1, m), 0.0f);
+	Vec f = SpringForce(r0, r1, restLength, springForce, precision, energy);
+	Halide::Expr exists = x1 == x + dx && y1 == y + dy;
+	if (energy) {
+		*energy = Halide::select(exists, *energy, 0.0f);
+	}
+	Halide::Expr outx = Halide::select(exists, f.x, 0.0f);
+	Halide::Expr outy = Halide::select(exists, f.y, 0.0f);
+	return Vec(outx, outy, 0);
+}
+
+// Total force on a mass point from its 8 neighbours. Diagonal springs are longer by sqrt(2). If
+// energy is given, it is set to half the energy of the point's springs, so that summing over points
+// counts each spring once.
+inline Vec MeshSpringForce(Halide::Func state, Halide::Expr width, Halide::Expr height,
+						   Halide::Var x, Halide::Var y, Halide::Expr m,
+						   Halide::Expr restLength, Halide::Expr springForce,
+						   MathPrecision precision = PRECISION_EXACT, Halide::Expr* energy = 0) {
+	const float ROOT2 = 1.4142135623f;
+	Halide::Expr diagonal = ROOT2 * restLength;
+	Halide::Expr e[8];
+	Vec f = GridSpringForce(state, width, height, x, y, m,  0, -1, restLength, springForce, precision, &e[0])
+		  + GridSpringForce(state, width, height, x, y, m, -1,  0, restLength, springForce, precision, &e[1])
+		  + GridSpringForce(state, width, height, x, y, m,  1,  0, restLength, springForce, precision, &e[2])
+		  + GridSpringForce(state, width, height, x, y, m,  0,  1, restLength, springForce, precision, &e[3])
+		  + GridSpringForce(state, width, height, x, y, m, -1, -1, diagonal, springForce, precision, &e[4])
+		  + GridSpringForce(state, width, height, x, y, m, -1,  1, diagonal, springForce, precision, &e[5])
+		  + GridSpringForce(state, width, height, x, y, m,  1, -1, diagonal, springForce, precision, &e[6])
+		  + GridSpringForce(state, width, height, x, y, m,  1,  1, diagonal, springForce, precision, &e[7]);
+	if (energy) {
+		*energy = 0.5f * (e[0] + e[1] + e[2] + e[3] + e[4] + e[5] + e[6] + e[7]);
+	}
+	return f;
+}
+
+// Quantities in the telemetry output of SpringMesh, per mesh row
+const int SPRING_MESH_TELEMETRY_COUNT = 8;
+const TelemetryQuantity SPRING_MESH_TELEMETRY[SPRING_MESH_TELEMETRY_COUNT] = {
+	{ "kinetic", REDUCE_SUM },
+	{ "potential", REDUCE_SUM },
+	{ "momentum_x", REDUCE_SUM },
+	{ "momentum_y", REDUCE_SUM },
+	{ "min_x", REDUCE_MIN },
+	{ "min_y", REDUCE_MIN },
+	{ "max_x", REDUCE_MAX },
+	{ "max_y", REDUCE_MAX },
+};
+
+// If telemetry is given, it is defined as the per-row partials of the input state as
+// telemetry(row, quantity), with unit masses, for realizing alongside the result in one Pipeline.
+// The spring energy of each point comes out of the force evaluation, from the same spring lengths.
+template <typename INPUT>
+Halide::Func SpringMesh(INPUT input, Halide::Expr springForce, Halide::Expr restLength, Halide::Expr gravity,
+						MathPrecision precision = PRECISION_EXACT, Halide::Func* telemetry = 0) {
+	Halide::Func output;
+	Halide::Var x, y, z, m;
+	output(x, y, z) = input(x, y, z);
+
+	// View the single mesh as instance 0 of an ensemble
+	Halide::Func state;
+	state(x, y, z, m) = input(x, y, z);
+
+	Halide::Expr energy;
+	Vec f = MeshSpringForce(state, input.width(), input.height(), x, y, 0, restLength, springForce, precision, &energy);
+	Halide::Func force;
+	if (telemetry) {
+		// Computed once per point, since both the update and the telemetry read it
+		force(x, y) = Halide::Tuple(f.x, f.y, energy);
+		force.compute_root()
+			.vectorize(x, 8);
+	} else {
+		force(x, y) = Halide::Tuple(f.x, f.y);
+	}
+	output(x, y, 0) = input(x, y, 0) + input(x, y, 2) + force(x, y)[0];
+	output(x, y, 1) = input(x, y, 1) + input(x, y, 3) + force(x, y)[1] + gravity;
+	output(x, y, 2) = input(x, y, 2) + force(x, y)[0];
+	output(x, y, 3) = input(x, y, 3) + force(x, y)[1] + gravity;
+
+	Halide::Var xo, yo, xi, yi;
+	output.tile(x, y, xo, yo, xi, yi, 32, 8).vectorize(xi).unroll(yi);
+
+	if (telemetry) {
+		Halide::RDom r(0, input.width());
+		const float inf = std::numeric_limits<float>::infinity();
+
+		Halide::Func partials;
+		partials(y) = Halide::Tuple(0.0f, 0.0f, 0.0f, 0.0f, inf, inf, -inf, -inf);
+		partials(y) = Halide::Tuple(partials(y)[0] + 0.5f * (input(r, y, 2) * input(r, y, 2) + input(r, y, 3) * input(r, y, 3)),
+									partials(y)[1] + force(r, y)[2],
+									partials(y)[2] + input(r, y, 2),
+									partials(y)[3] + input(r, y, 3),
+									Halide::min(partials(y)[4], input(r, y, 0)),
+									Halide::min(partials(y)[5], input(r, y, 1)),
+									Halide::max(partials(y)[6], input(r, y, 0)),
+									Halide::max(partials(y)[7], input(r, y, 1)));
+		*telemetry = TelemetryColumns(partials, SPRING_MESH_TELEMETRY_COUNT);
+	}
+
+	// We'll deal with the edge cases later
+	return output;
+}
+
+// Ensemble version of SpringMesh. input(x, y, plane, m) holds M independent meshes, and
+// params(m, p) holds the spring force (p = 0), rest length (p = 1) and gravity (p = 2) of mesh m.
+template <typename INPUT, typename PARAMS>
+Halide::Func SpringMeshEnsemble(INPUT input, PARAMS params, MathPrecision precision = PRECISION_EXACT) {
+	Halide::Func output;
+	Halide::Var x, y, z, m;
+	output(x, y, z, m) = input(x, y, z, m);
+
+	Halide::Func state;
+	state(x, y, z, m) = input(x, y, z, m);
+
+	Halide::Expr springForce = params(m, 0);
+	Halide::Expr restLength = params(m, 1);
+	Halide::Expr gravity = params(m, 2);
+
+	Vec f = MeshSpringForce(state, input.width(), input.height(), x, y, m, restLength, springForce, precision);
+	output(x, y, 0, m) = input(x, y, 0, m) + input(x, y, 2, m) + f.x;
+	output(x, y, 1, m) = input(x, y, 1, m) + input(x, y, 3, m) + f.y + gravity;
+	output(x, y, 2, m) = input(x, y, 2, m) + f.x;
+	output(x, y, 3, m) = input(x, y, 3, m) + f.y + gravity;
+
+	Halide::Var xo, yo, xi, yi;
+	output.tile(x, y, xo, yo, xi, yi, 32, 8).vectorize(xi).unroll(yi);
+	output.parallel(m);
+	for (int up = 0; up < 4; ++up) {
+		output.update(up).vectorize(x, 8).parallel(m);
+	}
+
+	return output;
+}
+
+}
+
+#endif // HalideExamples_SpringMesh_h
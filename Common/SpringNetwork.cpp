@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "SpringNetwork.h"
+
+namespace HalideExamples {
+
+SpringNetwork::SpringNetwork(int nodeCount, const std::vector<Spring>& springs)
+	: nodeCount(nodeCount)
+	, degree(0)
+	, springs(springs)
+	, order(nodeCount)
+{
+	for (int i = 0; i < nodeCount; ++i) {
+		order[i] = i;
+	}
+	build();
+}
+
+int SpringNetwork::nodes() const {
+	return nodeCount;
+}
+
+int SpringNetwork::edges() const {
+	return 2 * static_cast<int>(springs.size());
+}
+
+int SpringNetwork::maxDegree() const {
+	return degree;
+}
+
+int SpringNetwork::bandwidth() const {
+	int result = 0;
+	for (size_t s = 0; s < springs.size(); ++s) {
+		result = std::max(result, std::abs(springs[s].a - springs[s].b));
+	}
+	return result;
+}
+
+const std::vector<int>& SpringNetwork::permutation() const {
+	return order;
+}
+
+Halide::Image<int32_t>& SpringNetwork::offsets() {
+	return rowOffsets;
+}
+
+Halide::Image<int32_t>& SpringNetwork::neighbours() {
+	return columns;
+}
+
+Halide::Image<float>& SpringNetwork::restLengths() {
+	return rest;
+}
+
+void SpringNetwork::build() {
+	std::vector<int> counts(nodeCount + 1, 0);
+	for (size_t s = 0; s < springs.size(); ++s) {
+		++counts[springs[s].a + 1];
+		++counts[springs[s].b + 1];
+	}
+	degree = 0;
+	for (int i = 0; i < nodeCount; ++i) {
+		degree = std::max(degree, counts[i + 1]);
+		counts[i + 1] += counts[i];
+	}
+
+	rowOffsets = Halide::Image<int32_t>(nodeCount + 1);
+	columns = Halide::Image<int32_t>(edges());
+	rest = Halide::Image<float>(edges());
+	for (int i = 0; i <= nodeCount; ++i) {
+		rowOffsets(i) = counts[i];
+	}
+
+	// Scatter both ends of each spring into their rows, then sort the rows by neighbour
+	std::vector<std::pair<int, float> > entries(edges());
+	for (size_t s = 0; s < springs.size(); ++s) {
+		const Spring& spring = springs[s];
+		entries[counts[spring.a]++] = std::make_pair(spring.b, spring.restLength);
+		entries[counts[spring.b]++] = std::make_pair(spring.a, spring.restLength);
+	}
+	for (int i = 0; i < nodeCount; ++i) {
+		std::sort(entries.begin() + rowOffsets(i), entries.begin() + rowOffsets(i + 1));
+	}
+	for (int e = 0; e < edges(); ++e) {
+		columns(e) = entries[e].first;
+		rest(e) = entries[e].second;
+	}
+}
+
+void SpringNetwork::reorder() {
+	std::vector<int> degrees(nodeCount);
+	std::vector<int> byDegree(nodeCount);
+	for (int i = 0; i < nodeCount; ++i) {
+		degrees[i] = rowOffsets(i + 1) - rowOffsets(i);
+		byDegree[i] = i;
+	}
+	std::stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b) { return degrees[a] < degrees[b]; });
+
+	// Cuthill-McKee: breadth-first from a lowest-degree node of each component, visiting
+	// neighbours in order of increasing degree
+	std::vector<int> visit;
+	visit.reserve(nodeCount);
+	std::vector<bool> visited(nodeCount, false);
+	std::vector<int> next;
+	for (int s = 0; s < nodeCount; ++s) {
+		int start = byDegree[s];
+		if (visited[start]) {
+			continue;
+		}
+		visited[start] = true;
+		size_t head = visit.size();
+		visit.push_back(start);
+		while (head < visit.size()) {
+			int node = visit[head++];
+			next.clear();
+			for (int e = rowOffsets(node); e < rowOffsets(node + 1); ++e) {
+				int j = columns(e);
+				if (!visited[j]) {
+					visited[j] = true;
+					next.push_back(j);
+				}
+			}
+			std::stable_sort(next.begin(), next.end(), [&](int a, int b) { return degrees[a] < degrees[b]; });
+			visit.insert(visit.end(), next.begin(), next.end());
+		}
+	}
+
+	// ...reversed, which tends to shrink the profile further
+	std::reverse(visit.begin(), visit.end());
+	std::vector<int> renumber(nodeCount);
+	std::vector<int> newOrder(nodeCount);
+	for (int i = 0; i < nodeCount; ++i) {
+		renumber[visit[i]] = i;
+		newOrder[i] = order[visit[i]];
+	}
+	order.swap(newOrder);
+	for (size_t s = 0; s < springs.size(); ++s) {
+		springs[s].a = renumber[springs[s].a];
+		springs[s].b = renumber[springs[s].b];
+	}
+	build();
+}
+
+SpringNetwork GridSpringNetwork(int width, int height, float restLength, std::vector<int>& gridIndex) {
+	const int nodes = width * height;
+	std::vector<int> shuffled(nodes);
+	for (int i = 0; i < nodes; ++i) {
+		shuffled[i] = i;
+	}
+	for (int i = nodes - 1; i > 0; --i) {
+		std::swap(shuffled[i], shuffled[std::rand() % (i + 1)]);
+	}
+
+	// Each point connects forward to its right, lower and two lower diagonal neighbours, so every
+	// spring of the 8-neighbour grid is made once
+	std::vector<Spring> springs;
+	const int offsets[4][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { -1, 1 } };
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			for (int o = 0; o < 4; ++o) {
+				int x1 = x + offsets[o][0];
+				int y1 = y + offsets[o][1];
+				if (x1 < 0 || x1 >= width || y1 >= height) {
+					continue;
+				}
+				Spring spring;
+				spring.a = shuffled[y * width + x];
+				spring.b = shuffled[y1 * width + x1];
+				spring.restLength = (x1 != x && y1 != y) ? 1.4142135623f * restLength : restLength;
+				springs.push_back(spring);
+			}
+		}
+	}
+
+	gridIndex.resize(nodes);
+	for (int i = 0; i < nodes; ++i) {
+		gridIndex[shuffled[i]] = i;
+	}
+	return SpringNetwork(nodes, springs);
+}
+
+}
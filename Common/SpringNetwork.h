@@ -0,0 +1,115 @@
+#ifndef HalideExamples_SpringNetwork_h
+#define HalideExamples_SpringNetwork_h
+
+#include <cstdint>
+#include <vector>
+
+#include <Halide.h>
+
+#include "SpringMesh.h"
+
+namespace HalideExamples {
+
+// A spring between nodes a and b
+struct Spring {
+	int a;
+	int b;
+	float restLength;
+};
+
+// Connectivity of an arbitrary spring network in compressed sparse row form.
+//
+// Each spring is stored in the rows of both of its ends: the neighbours of node i are
+// neighbours(offsets(i)) up to neighbours(offsets(i + 1) - 1), sorted by index, with the matching
+// rest lengths alongside. reorder() renumbers the nodes in reverse Cuthill-McKee order, which
+// keeps connected nodes close together so the force gather stays within a few cache lines.
+class SpringNetwork {
+public:
+	SpringNetwork(int nodeCount, const std::vector<Spring>& springs);
+
+	// Renumber nodes to reduce bandwidth. permutation() maps the new numbers to the original ones.
+	void reorder();
+
+	int nodes() const;
+	int edges() const;
+	int maxDegree() const;
+
+	// Largest index distance between two connected nodes
+	int bandwidth() const;
+
+	// Original number of each node, indexed by its current number
+	const std::vector<int>& permutation() const;
+
+	Halide::Image<int32_t>& offsets();
+	Halide::Image<int32_t>& neighbours();
+	Halide::Image<float>& restLengths();
+
+private:
+	void build();
+
+	int nodeCount;
+	int degree;
+	std::vector<Spring> springs;
+	std::vector<int> order;
+	Halide::Image<int32_t> rowOffsets;
+	Halide::Image<int32_t> columns;
+	Halide::Image<float> rest;
+};
+
+// The width x height grid of SpringMesh as a spring network, with the nodes numbered in random
+// order as a loaded mesh might be. gridIndex(i) is set to the grid point (x + width * y) of
+// network node i. The network is not reordered.
+SpringNetwork GridSpringNetwork(int width, int height, float restLength, std::vector<int>& gridIndex);
+
+// One explicit step of a spring network, with the same integration as SpringMesh. input(i, plane)
+// holds the node positions x, y and velocities x, y; offsets, neighbours and restLengths come from
+// a SpringNetwork. Each node gathers the forces of up to maxDegree springs from its CSR row.
+// Realize over at least 1024 nodes.
+template <typename INPUT, typename OFFSETS, typename NEIGHBOURS, typename REST>
+Halide::Func SpringNetworkStep(INPUT input, OFFSETS offsets, NEIGHBOURS neighbours, REST restLengths, int maxDegree,
+							   Halide::Expr springForce, Halide::Expr gravity, MathPrecision precision = PRECISION_EXACT) {
+	Halide::Var i, z;
+	Halide::RDom k(0, maxDegree);
+
+	// Rows shorter than maxDegree are padded out with springs that contribute nothing
+	Halide::Expr e = offsets(i) + k;
+	Halide::Expr valid = e < offsets(i + 1);
+	Halide::Expr edge = Halide::clamp(e, 0, neighbours.width() - 1);
+	Halide::Expr j = Halide::clamp(neighbours(edge), 0, offsets.width() - 2);
+
+	Vec r0(input(i, 0), input(i, 1), 0.0f);
+	Vec r1(input(j, 0), input(j, 1), 0.0f);
+	Vec f = SpringForce(r0, r1, restLengths(edge), springForce, precision);
+
+	Halide::Func force;
+	force(i) = Halide::Tuple(0.0f, 0.0f);
+	force(i) = Halide::Tuple(force(i)[0] + Halide::select(valid, f.x, 0.0f),
+							 force(i)[1] + Halide::select(valid, f.y, 0.0f));
+
+	Halide::Expr fx = force(i)[0];
+	Halide::Expr fy = force(i)[1] + gravity;
+	Halide::Func output;
+	output(i, z) = Halide::select(z == 0, input(i, 0) + input(i, 2) + fx,
+				   Halide::select(z == 1, input(i, 1) + input(i, 3) + fy,
+				   Halide::select(z == 2, input(i, 2) + fx,
+											input(i, 3) + fy)));
+
+	// Blocks of nodes in parallel, writing each plane contiguously
+	Halide::Var io, ii;
+	output.bound(z, 0, 4)
+		.split(i, io, ii, 1024)
+		.reorder(ii, z, io)
+		.unroll(z)
+		.vectorize(ii, 8)
+		.parallel(io);
+	force.compute_at(output, io)
+		.vectorize(i, 8);
+	force.update()
+		.vectorize(i, 8);
+
+	return output;
+}
+
+}
+
+#endif // HalideExamples_SpringNetwork_h
@@ -0,0 +1,56 @@
+#include <algorithm>
+
+#include "StreamCompaction.h"
+#include "ThreadPool.h"
+
+namespace HalideExamples {
+
+namespace {
+
+// Big enough to amortize the task overhead, small enough to balance across the pool
+const int COMPACTION_BLOCK = 16384;
+
+}
+
+int CompactPlanes(const std::vector<const float*>& src, const std::vector<float*>& dst, const uint8_t* mask, int count) {
+	int blocks = (count + COMPACTION_BLOCK - 1) / COMPACTION_BLOCK;
+	std::vector<int> offsets(blocks + 1, 0);
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Count the survivors in each block
+	pool.parallelFor(0, blocks, [&](int b) {
+		int begin = b * COMPACTION_BLOCK;
+		int end = std::min(count, begin + COMPACTION_BLOCK);
+		int kept = 0;
+		for (int i = begin; i < end; ++i) {
+			kept += mask[i] != 0;
+		}
+		offsets[b + 1] = kept;
+		return 0;
+	});
+
+	// Exclusive prefix sum of the block counts gives each block's first output slot
+	for (int b = 0; b < blocks; ++b) {
+		offsets[b + 1] += offsets[b];
+	}
+
+	// Scatter each block's survivors, one plane at a time so reads and writes stay sequential
+	pool.parallelFor(0, blocks, [&](int b) {
+		int begin = b * COMPACTION_BLOCK;
+		int end = std::min(count, begin + COMPACTION_BLOCK);
+		for (size_t p = 0; p < src.size(); ++p) {
+			const float* in = src[p];
+			float* out = dst[p] + offsets[b];
+			for (int i = begin; i < end; ++i) {
+				if (mask[i]) {
+					*out++ = in[i];
+				}
+			}
+		}
+		return 0;
+	});
+
+	return offsets[blocks];
+}
+
+}
@@ -0,0 +1,20 @@
+#ifndef HalideExamples_StreamCompaction_h
+#define HalideExamples_StreamCompaction_h
+
+#include <cstdint>
+#include <vector>
+
+namespace HalideExamples {
+
+// Copy the elements of each source plane whose mask entry is nonzero to the front of the matching
+// destination plane, keeping their order, and return how many were kept. Source and destination
+// planes must not overlap.
+//
+// This is a parallel stream compaction: the mask is counted per block in parallel, the block
+// counts are prefix-summed into output offsets, and then every block scatters its survivors in
+// parallel.
+int CompactPlanes(const std::vector<const float*>& src, const std::vector<float*>& dst, const uint8_t* mask, int count);
+
+}
+
+#endif // HalideExamples_StreamCompaction_h
@@ -0,0 +1,159 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <thread>
+
+#include "Telemetry.h"
+#include "ThreadPool.h"
+
+namespace HalideExamples {
+
+// Layout of the shared segment. sequence is odd while a write is in progress.
+struct Segment {
+	std::atomic<uint32_t> sequence;
+	TelemetrySnapshot snapshot;
+};
+
+void ReducePartials(Halide::Image<float>& partials, const TelemetryQuantity* quantities, int count, TelemetrySnapshot& snapshot) {
+	for (int q = 0; q < count && snapshot.count < TELEMETRY_MAX_VALUES; ++q) {
+		double value = 0.0;
+		if (quantities[q].reduce == REDUCE_MIN) {
+			value = std::numeric_limits<double>::infinity();
+		} else if (quantities[q].reduce == REDUCE_MAX) {
+			value = -std::numeric_limits<double>::infinity();
+		}
+		for (int t = 0; t < partials.width(); ++t) {
+			double partial = partials(t, q);
+			switch (quantities[q].reduce) {
+			case REDUCE_SUM: value += partial; break;
+			case REDUCE_MIN: value = std::min(value, partial); break;
+			case REDUCE_MAX: value = std::max(value, partial); break;
+			}
+		}
+		std::strncpy(snapshot.names[snapshot.count], quantities[q].name, TELEMETRY_NAME_LENGTH - 1);
+		snapshot.names[snapshot.count][TELEMETRY_NAME_LENGTH - 1] = 0;
+		snapshot.values[snapshot.count] = value;
+		++snapshot.count;
+	}
+}
+
+TelemetryPublisher::TelemetryPublisher(const std::string& name)
+	: name("/" + name)
+	, segment(0)
+	, busy(false)
+{
+	int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		std::printf("Could not create telemetry segment %s\n", this->name.c_str());
+		return;
+	}
+	if (ftruncate(fd, sizeof(Segment)) == 0) {
+		void* p = mmap(0, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			segment = new (p) Segment();
+			segment->sequence.store(0, std::memory_order_relaxed);
+			std::memset(&segment->snapshot, 0, sizeof(TelemetrySnapshot));
+		}
+	}
+	close(fd);
+}
+
+TelemetryPublisher::~TelemetryPublisher() {
+	while (busy) {
+		std::this_thread::yield();
+	}
+	if (segment) {
+		munmap(segment, sizeof(Segment));
+		shm_unlink(name.c_str());
+	}
+}
+
+bool TelemetryPublisher::valid() const {
+	return segment != 0;
+}
+
+void TelemetryPublisher::publish(const TelemetrySnapshot& snapshot) {
+	if (!segment) {
+		return;
+	}
+	// Writes never overlap, so the sequence can be bumped without a read-modify-write
+	uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+	segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(&segment->snapshot, &snapshot, sizeof(TelemetrySnapshot));
+	segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool TelemetryPublisher::publishAsync(Halide::Image<float>& partials, const TelemetryQuantity* quantities, int count, uint64_t frame) {
+	if (!segment || busy.exchange(true)) {
+		return false;
+	}
+	if (!staging.defined() || staging.width() != partials.width() || staging.height() != partials.height()) {
+		staging = Halide::Image<float>(partials.width(), partials.height());
+	}
+	for (int q = 0; q < partials.height(); ++q) {
+		for (int t = 0; t < partials.width(); ++t) {
+			staging(t, q) = partials(t, q);
+		}
+	}
+	ThreadPool::shared().submit([this, quantities, count, frame]() {
+		TelemetrySnapshot snapshot;
+		snapshot.frame = frame;
+		snapshot.count = 0;
+		ReducePartials(staging, quantities, count, snapshot);
+		publish(snapshot);
+		busy = false;
+	});
+	return true;
+}
+
+TelemetryReader::TelemetryReader(const std::string& name)
+	: segment(0)
+{
+	std::string path = "/" + name;
+	int fd = shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		return;
+	}
+	void* p = mmap(0, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+	if (p != MAP_FAILED) {
+		segment = static_cast<const Segment*>(p);
+	}
+	close(fd);
+}
+
+TelemetryReader::~TelemetryReader() {
+	if (segment) {
+		munmap(const_cast<Segment*>(segment), sizeof(Segment));
+	}
+}
+
+bool TelemetryReader::valid() const {
+	return segment != 0;
+}
+
+bool TelemetryReader::read(TelemetrySnapshot& snapshot) const {
+	if (!segment) {
+		return false;
+	}
+	while (true) {
+		uint32_t before = segment->sequence.load(std::memory_order_acquire);
+		if (before & 1) {
+			continue;
+		}
+		std::memcpy(&snapshot, &segment->snapshot, sizeof(TelemetrySnapshot));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t after = segment->sequence.load(std::memory_order_relaxed);
+		if (before == after) {
+			return before != 0;
+		}
+	}
+}
+
+}
@@ -0,0 +1,110 @@
+#ifndef HalideExamples_Telemetry_h
+#define HalideExamples_Telemetry_h
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// Live simulation telemetry, published through a POSIX shared memory segment.
+//
+// The simulation pipelines can emit per-tile partial reductions (energies, momenta, bounds)
+// in the same realize as their state update. The Grav potential and the SpringMesh spring energy
+// come out of the force evaluation, and the implicit SpringMesh solver accumulates its partials
+// while moving the mesh. The Wave partials are the exception: see WaveTelemetry.
+// ReducePartials() combines the partials of a step into a snapshot, and a TelemetryPublisher
+// writes it into the segment under a seqlock, so a monitor in another process can read consistent
+// snapshots with TelemetryReader without ever blocking the simulation.
+
+const int TELEMETRY_MAX_VALUES = 16;
+const int TELEMETRY_NAME_LENGTH = 32;
+
+struct TelemetrySnapshot {
+	uint64_t frame;
+	int32_t count;
+	char names[TELEMETRY_MAX_VALUES][TELEMETRY_NAME_LENGTH];
+	double values[TELEMETRY_MAX_VALUES];
+};
+
+// How the partials of one quantity combine across tiles
+enum TelemetryReduce {
+	REDUCE_SUM,
+	REDUCE_MIN,
+	REDUCE_MAX
+};
+
+struct TelemetryQuantity {
+	const char* name;
+	TelemetryReduce reduce;
+};
+
+// Combine partials(tile, q) over tiles into one value per quantity q, appending them to snapshot
+void ReducePartials(Halide::Image<float>& partials, const TelemetryQuantity* quantities, int count, TelemetrySnapshot& snapshot);
+
+// Lay out the Tuple partials(tile) as columns(tile, quantity), so the partials of all quantities
+// can be realized into one buffer. Tiles are computed in parallel.
+inline Halide::Func TelemetryColumns(Halide::Func partials, int count) {
+	Halide::Func columns;
+	Halide::Var t, q;
+	Halide::Expr value = partials(t)[count - 1];
+	for (int k = count - 2; k >= 0; --k) {
+		value = Halide::select(q == k, partials(t)[k], value);
+	}
+	columns(t, q) = value;
+	columns.bound(q, 0, count)
+		.reorder(q, t)
+		.unroll(q)
+		.parallel(t);
+	partials.compute_at(columns, t);
+	return columns;
+}
+
+// Writer side. Creates the segment /<name>, and removes it again on destruction.
+class TelemetryPublisher {
+public:
+	explicit TelemetryPublisher(const std::string& name);
+	~TelemetryPublisher();
+
+	bool valid() const;
+	void publish(const TelemetrySnapshot& snapshot);
+
+	// Copy the partials of a step and reduce and publish them as a task on the shared ThreadPool,
+	// off the simulation thread. If the previous snapshot is still being published this one is
+	// dropped, and false is returned.
+	bool publishAsync(Halide::Image<float>& partials, const TelemetryQuantity* quantities, int count, uint64_t frame);
+
+private:
+	TelemetryPublisher(const TelemetryPublisher&);
+	TelemetryPublisher& operator=(const TelemetryPublisher&);
+
+	std::string name;
+	struct Segment* segment;
+	Halide::Image<float> staging;
+	std::atomic<bool> busy;
+};
+
+// Reader side, for monitors. Opens an existing segment read-only.
+class TelemetryReader {
+public:
+	explicit TelemetryReader(const std::string& name);
+	~TelemetryReader();
+
+	bool valid() const;
+
+	// Copy out the latest snapshot, retrying while a write is in progress. Returns false if
+	// nothing has been published yet.
+	bool read(TelemetrySnapshot& snapshot) const;
+
+private:
+	TelemetryReader(const TelemetryReader&);
+	TelemetryReader& operator=(const TelemetryReader&);
+
+	const struct Segment* segment;
+};
+
+}
+
+#endif // HalideExamples_Telemetry_h
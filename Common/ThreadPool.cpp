@@ -0,0 +1,342 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "ThreadPool.h"
+
+namespace HalideExamples {
+
+namespace {
+
+// The pool and worker index of the current thread, if it is a worker
+thread_local ThreadPool* currentPool = 0;
+thread_local int currentWorker = -1;
+
+int EnvInt(const char* name, int defaultValue) {
+	const char* value = std::getenv(name);
+	return value ? std::atoi(value) : defaultValue;
+}
+
+// Parse a sysfs CPU list such as "0-3,8-11"
+std::vector<int> ParseCpuList(const std::string& list) {
+	std::vector<int> cpus;
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ',')) {
+		int first, last;
+		if (std::sscanf(range.c_str(), "%d-%d", &first, &last) == 2) {
+			for (int cpu = first; cpu <= last; ++cpu) {
+				cpus.push_back(cpu);
+			}
+		} else if (std::sscanf(range.c_str(), "%d", &first) == 1) {
+			cpus.push_back(first);
+		}
+	}
+	return cpus;
+}
+
+// CPUs of each NUMA node. Machines without NUMA information are treated as a single node.
+std::vector<std::vector<int> > NumaNodes() {
+	std::vector<std::vector<int> > nodes;
+	for (int node = 0; ; ++node) {
+		std::ostringstream path;
+		path << "/sys/devices/system/node/node" << node << "/cpulist";
+		std::ifstream in(path.str().c_str());
+		std::string list;
+		if (!std::getline(in, list)) {
+			break;
+		}
+		nodes.push_back(ParseCpuList(list));
+	}
+	if (nodes.empty()) {
+		nodes.push_back(std::vector<int>());
+		int cpus = std::max(1u, std::thread::hardware_concurrency());
+		for (int cpu = 0; cpu < cpus; ++cpu) {
+			nodes[0].push_back(cpu);
+		}
+	}
+	return nodes;
+}
+
+}
+
+ThreadPool::Options::Options()
+	: threads(EnvInt("HALIDE_EXAMPLES_THREADS", std::max(1u, std::thread::hardware_concurrency())))
+	, pinThreads(EnvInt("HALIDE_EXAMPLES_PIN", 0) != 0)
+	, numaAware(EnvInt("HALIDE_EXAMPLES_NUMA", 0) != 0)
+{
+}
+
+ThreadPool::ThreadPool(const Options& options)
+	: pending(0)
+	, nextWorker(0)
+	, stopping(false)
+	, statsStart(std::chrono::steady_clock::now())
+{
+	int threads = std::max(1, options.threads);
+	for (int i = 0; i < threads; ++i) {
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+	place(options);
+	for (int i = 0; i < threads; ++i) {
+		workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i]->thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+int ThreadPool::threadCount() const {
+	return static_cast<int>(workers.size());
+}
+
+// Assign each worker a CPU and node, and decide the order in which it steals from the others
+void ThreadPool::place(const Options& options) {
+	std::vector<std::vector<int> > nodes = NumaNodes();
+	int count = threadCount();
+
+	// Without NUMA placement, workers take CPUs in numeric order
+	std::vector<std::pair<int, int> > slots;	// (cpu, node)
+	for (size_t node = 0; node < nodes.size(); ++node) {
+		for (size_t i = 0; i < nodes[node].size(); ++i) {
+			slots.push_back(std::make_pair(nodes[node][i], static_cast<int>(node)));
+		}
+	}
+	if (!options.numaAware) {
+		std::sort(slots.begin(), slots.end());
+	}
+
+	for (int w = 0; w < count; ++w) {
+		const std::pair<int, int>& slot = slots[w % slots.size()];
+		workers[w]->cpu = options.pinThreads ? slot.first : -1;
+		workers[w]->node = options.numaAware ? slot.second : 0;
+	}
+
+	for (int w = 0; w < count; ++w) {
+		std::vector<int>& victims = workers[w]->victims;
+		for (int i = 1; i < count; ++i) {
+			victims.push_back((w + i) % count);
+		}
+		// Same-node victims first
+		int node = workers[w]->node;
+		std::stable_partition(victims.begin(), victims.end(), [&](int v) {
+			return workers[v]->node == node;
+		});
+	}
+}
+
+void ThreadPool::push(int worker, std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+		workers[worker]->queue.push_back(std::move(task));
+	}
+	++pending;
+	// Taking the lock orders this push with a worker that is just about to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+bool ThreadPool::take(int self, std::function<void()>& task) {
+	if (self >= 0) {
+		Worker& worker = *workers[self];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (!worker.queue.empty()) {
+			task = std::move(worker.queue.back());
+			worker.queue.pop_back();
+			--pending;
+			return true;
+		}
+	}
+
+	int count = threadCount();
+	for (int i = 0; i < count - (self >= 0 ? 1 : 0); ++i) {
+		int v = self >= 0 ? workers[self]->victims[i] : i;
+		Worker& victim = *workers[v];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.queue.empty()) {
+			task = std::move(victim.queue.front());
+			victim.queue.pop_front();
+			--pending;
+			if (self >= 0) {
+				++workers[self]->steals;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(int self, std::function<void()>& task) {
+	if (self < 0) {
+		task();
+		return;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	task();
+	std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+	workers[self]->busyNs += elapsed.count();
+	++workers[self]->tasks;
+}
+
+void ThreadPool::workerLoop(int self) {
+	currentPool = this;
+	currentWorker = self;
+
+	int cpu = workers[self]->cpu;
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+
+	std::function<void()> task;
+	while (true) {
+		if (take(self, task)) {
+			run(self, task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return pending > 0 || stopping; });
+		if (stopping && pending == 0) {
+			return;
+		}
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	int self = currentPool == this ? currentWorker : -1;
+	push(self >= 0 ? self : nextWorker++ % threadCount(), std::move(task));
+}
+
+int ThreadPool::parallelFor(int min, int size, const std::function<int(int)>& body) {
+	if (size <= 0) {
+		return 0;
+	}
+
+	struct Batch {
+		std::atomic<int> remaining;
+		std::atomic<int> result;
+	};
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+
+	// A few chunks per worker leaves room for stealing to balance uneven iterations
+	int chunks = std::min(size, 4 * threadCount());
+	batch->remaining = chunks;
+	batch->result = 0;
+
+	// A worker keeps its chunks to itself until others steal them; other threads spread them out
+	int self = currentPool == this ? currentWorker : -1;
+	for (int c = 0; c < chunks; ++c) {
+		int begin = min + static_cast<int>(static_cast<int64_t>(size) * c / chunks);
+		int end = min + static_cast<int>(static_cast<int64_t>(size) * (c + 1) / chunks);
+		std::function<void()> task = [this, batch, begin, end, &body]() {
+			for (int i = begin; i < end && batch->result == 0; ++i) {
+				int result = body(i);
+				if (result != 0) {
+					int expected = 0;
+					batch->result.compare_exchange_strong(expected, result);
+				}
+			}
+			if (--batch->remaining == 0) {
+				// Wake the caller if it is asleep below; the lock orders this with its check
+				{
+					std::lock_guard<std::mutex> lock(sleepMutex);
+				}
+				wake.notify_all();
+			}
+		};
+		push(self >= 0 ? self : nextWorker++ % threadCount(), std::move(task));
+	}
+
+	// Help out until every chunk is done. With nothing left to steal, sleep until more work is
+	// queued or the last chunk finishes, so the caller doesn't compete with the workers for a core.
+	std::function<void()> task;
+	while (batch->remaining > 0) {
+		if (take(self, task)) {
+			run(self, task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [&] { return pending > 0 || batch->remaining == 0; });
+	}
+	return batch->result;
+}
+
+std::vector<ThreadPool::WorkerStats> ThreadPool::stats() const {
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - statsStart;
+	std::vector<WorkerStats> result;
+	for (size_t i = 0; i < workers.size(); ++i) {
+		WorkerStats s;
+		s.cpu = workers[i]->cpu;
+		s.node = workers[i]->node;
+		s.tasks = workers[i]->tasks;
+		s.steals = workers[i]->steals;
+		s.busyMs = workers[i]->busyNs * 1e-6;
+		s.utilization = elapsed.count() > 0.0 ? s.busyMs / elapsed.count() : 0.0;
+		result.push_back(s);
+	}
+	return result;
+}
+
+void ThreadPool::resetStats() {
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i]->tasks = 0;
+		workers[i]->steals = 0;
+		workers[i]->busyNs = 0;
+	}
+	statsStart = std::chrono::steady_clock::now();
+}
+
+void ThreadPool::printStats() const {
+	std::vector<WorkerStats> s = stats();
+	for (size_t i = 0; i < s.size(); ++i) {
+		std::printf("worker %2d: cpu %3d node %d tasks %8llu steals %8llu busy %5.1f%%\n",
+			static_cast<int>(i), s[i].cpu, s[i].node,
+			static_cast<unsigned long long>(s[i].tasks), static_cast<unsigned long long>(s[i].steals),
+			100.0 * s[i].utilization);
+	}
+}
+
+int ThreadPoolDoTask(void* userContext, int (*f)(void*, int, uint8_t*), int idx, uint8_t* closure) {
+	return f(userContext, idx, closure);
+}
+
+int ThreadPoolDoParFor(void* userContext, int (*f)(void*, int, uint8_t*), int min, int size, uint8_t* closure) {
+	return ThreadPool::shared().parallelFor(min, size, [=](int idx) {
+		return ThreadPoolDoTask(userContext, f, idx, closure);
+	});
+}
+
+void UseThreadPool(Halide::Func& f) {
+	f.set_custom_do_par_for(ThreadPoolDoParFor);
+	f.set_custom_do_task(ThreadPoolDoTask);
+}
+
+void UseThreadPool(Halide::Pipeline& p) {
+	p.set_custom_do_par_for(ThreadPoolDoParFor);
+	p.set_custom_do_task(ThreadPoolDoTask);
+}
+
+}
@@ -0,0 +1,109 @@
+#ifndef HalideExamples_ThreadPool_h
+#define HalideExamples_ThreadPool_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Halide.h>
+
+namespace HalideExamples {
+
+// A work-stealing thread pool shared by Halide's parallel loops and the application's own
+// asynchronous tasks, so the two don't oversubscribe the machine.
+//
+// Each worker owns a deque of tasks. It pops its own tasks LIFO and, when out of work, steals
+// FIFO from other workers, preferring those on the same NUMA node. A thread waiting on a parallel
+// loop runs queued tasks itself, so nested parallelism can't deadlock, and sleeps once there is
+// nothing left to take.
+//
+// The shared pool is configured from the environment when it is first used:
+//   HALIDE_EXAMPLES_THREADS   number of workers (default: hardware concurrency)
+//   HALIDE_EXAMPLES_PIN       1 to pin each worker to one CPU
+//   HALIDE_EXAMPLES_NUMA      1 to place workers node by node and steal within a node first
+class ThreadPool {
+public:
+	struct Options {
+		Options();
+
+		int threads;
+		bool pinThreads;
+		bool numaAware;
+	};
+
+	// Per-worker utilization counters
+	struct WorkerStats {
+		int cpu;			// CPU the worker is pinned to, or -1
+		int node;			// NUMA node of the worker
+		uint64_t tasks;		// tasks run
+		uint64_t steals;	// tasks taken from another worker
+		double busyMs;		// time spent running tasks
+		double utilization;	// busyMs as a fraction of the time since the last reset
+	};
+
+	explicit ThreadPool(const Options& options = Options());
+	~ThreadPool();
+
+	static ThreadPool& shared();
+
+	int threadCount() const;
+
+	// Run a task asynchronously on some worker
+	void submit(std::function<void()> task);
+
+	// Run body(i) for every i in [min, min + size), in parallel, and return when all are done.
+	// Returns the first nonzero result of body, or 0.
+	int parallelFor(int min, int size, const std::function<int(int)>& body);
+
+	std::vector<WorkerStats> stats() const;
+	void resetStats();
+	void printStats() const;
+
+private:
+	struct Worker {
+		Worker() : cpu(-1), node(0), tasks(0), steals(0), busyNs(0) {}
+
+		std::thread thread;
+		std::mutex mutex;
+		std::deque<std::function<void()> > queue;
+		std::vector<int> victims;	// steal order
+		int cpu;
+		int node;
+		std::atomic<uint64_t> tasks;
+		std::atomic<uint64_t> steals;
+		std::atomic<uint64_t> busyNs;
+	};
+
+	void place(const Options& options);
+	void push(int worker, std::function<void()> task);
+	bool take(int self, std::function<void()>& task);
+	void run(int self, std::function<void()>& task);
+	void workerLoop(int self);
+
+	std::vector<std::unique_ptr<Worker> > workers;
+	std::atomic<int> pending;
+	std::atomic<unsigned int> nextWorker;
+	std::atomic<bool> stopping;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::chrono::steady_clock::time_point statsStart;
+};
+
+// Halide runtime hooks backed by the shared pool
+int ThreadPoolDoParFor(void* userContext, int (*f)(void*, int, uint8_t*), int min, int size, uint8_t* closure);
+int ThreadPoolDoTask(void* userContext, int (*f)(void*, int, uint8_t*), int idx, uint8_t* closure);
+
+// Route a pipeline's parallel loops through the shared pool
+void UseThreadPool(Halide::Func& f);
+void UseThreadPool(Halide::Pipeline& p);
+
+}
+
+#endif // HalideExamples_ThreadPool_h
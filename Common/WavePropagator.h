@@ -0,0 +1,142 @@
+#ifndef HalideExamples_WavePropagator_h
+#define HalideExamples_WavePropagator_h
+
+#include <limits>
+
+#include <Halide.h>
+
+#include "CpuDispatch.h"
+#include "Shading.h"
+#include "Telemetry.h"
+
+namespace HalideExamples {
+
+////////////////////////// TELEMETRY //////////////////////////
+
+// Quantities in the telemetry output of the wave functions, per row of the field
+const int WAVE_TELEMETRY_COUNT = 3;
+const TelemetryQuantity WAVE_TELEMETRY[WAVE_TELEMETRY_COUNT] = {
+	{ "min", REDUCE_MIN },
+	{ "max", REDUCE_MAX },
+	{ "sum_squares", REDUCE_SUM },
+};
+
+// Per-row partials of the current field as telemetry(row, quantity). Only curr is read, since
+// next may be realized over prev in the same Pipeline. Unlike the other simulations' telemetry,
+// this is a second pass over curr: the partials are an output of the Pipeline, and this Halide
+// can't compute one output inside the tile loop of another.
+template <typename F2>
+Halide::Func WaveTelemetry(F2 curr) {
+	Halide::Var y;
+	Halide::RDom r(0, curr.width());
+	const float inf = std::numeric_limits<float>::infinity();
+	Halide::Func partials;
+	partials(y) = Halide::Tuple(inf, -inf, 0.0f);
+	partials(y) = Halide::Tuple(Halide::min(partials(y)[0], curr(r, y)),
+								Halide::max(partials(y)[1], curr(r, y)),
+								partials(y)[2] + curr(r, y) * curr(r, y));
+	return TelemetryColumns(partials, WAVE_TELEMETRY_COUNT);
+}
+
+////////////////////////// WAVE FUNCTION //////////////////////////
+
+// If telemetry is given, it is defined as WaveTelemetry(curr), for realizing alongside next in
+// one Pipeline.
+template <typename F1, typename F2, typename F3>
+Halide::Func WavePropagator(F1 prev, F2 curr, F3 scale, const ScheduleParams& schedule = CurrentSchedule(),
+							Halide::Func* telemetry = 0) {
+	Halide::Func next;
+	Halide::Var x, y, xi, yi, xo, yo;
+
+	////////////////////////// ALGORITHM //////////////////////////
+
+	// Discrete 2D wave equation. Forward time centered space (FTCS). There are far more sophisticated methods.
+	// prev is only read at the point being computed, so next may be realized over prev in place.
+	next(x, y) = scale(x, y) * (curr(x, y - 1) + curr(x - 1, y) + curr(x + 1, y) + curr(x, y + 1) - 4 * curr(x, y)) + 2 * curr(x, y) - prev(x, y);
+
+	////////////////////////// SCHEDULE //////////////////////////
+
+	// Split the space into blocks for parallelization (256x256 on every ISA)
+	Halide::Var tx, ty, nx, ny, ti;
+	next.tile(x, y, tx, ty, nx, ny, schedule.blockSize, schedule.blockSize);
+
+	// Split the blocks into smaller tiles sized for the ISA (32x16 on AVX2), vectorize and unroll
+	next.tile(nx, ny, xo, yo, xi, yi, schedule.tileWidth, schedule.tileHeight)
+		.vectorize(xi)
+		.unroll(yi);
+
+	// Run all blocks in parallel
+	next.fuse(tx, ty, ti);
+	next.parallel(ti);
+
+	if (telemetry) {
+		*telemetry = WaveTelemetry(curr);
+	}
+
+	return next;
+}
+
+// WavePropagator fused with SpecularShade of curr. Outputs a Tuple of the next wave values and the
+// shaded current field, computed tile by tile in one pass, so each tile of curr is read once for
+// both while it is in cache. Realize into a Realization of two buffers. telemetry is as for
+// WavePropagator.
+//
+// The shading is of curr, not next, so a display of it lags the simulation by one step. Shading
+// next would need next over a one-pixel apron around each tile, which reads prev in the
+// neighbouring tiles, and those may already have been overwritten when next is realized in place.
+template <typename F1, typename F2, typename F3>
+Halide::Func WavePropagatorShaded(F1 prev, F2 curr, F3 scale,
+								  Halide::Expr lx, Halide::Expr ly, Halide::Expr lz,
+								  Halide::Expr ex, Halide::Expr ey, Halide::Expr ez,
+								  const ScheduleParams& schedule = CurrentSchedule(), Halide::Func* telemetry = 0) {
+	Halide::Func next;
+	Halide::Var x, y, xi, yi, xo, yo;
+
+	Halide::Func height;
+	height(x, y) = curr(x, y);
+	Halide::Expr wave = scale(x, y) * (curr(x, y - 1) + curr(x - 1, y) + curr(x + 1, y) + curr(x, y + 1) - 4 * curr(x, y)) + 2 * curr(x, y) - prev(x, y);
+	next(x, y) = Halide::Tuple(wave, SpecularShade(height, x, y, lx, ly, lz, ex, ey, ez));
+
+	// Same blocks and tiles as WavePropagator
+	Halide::Var tx, ty, nx, ny, ti;
+	next.tile(x, y, tx, ty, nx, ny, schedule.blockSize, schedule.blockSize);
+	next.tile(nx, ny, xo, yo, xi, yi, schedule.tileWidth, schedule.tileHeight)
+		.vectorize(xi)
+		.unroll(yi);
+	next.fuse(tx, ty, ti);
+	next.parallel(ti);
+
+	if (telemetry) {
+		*telemetry = WaveTelemetry(curr);
+	}
+
+	return next;
+}
+
+// Ensemble version of WavePropagator. prev, curr and scale take a third coordinate m selecting
+// one of M independent fields, each with its own velocity map. Blocks of all fields are stepped
+// in one realize.
+template <typename F1, typename F2, typename F3>
+Halide::Func WavePropagatorEnsemble(F1 prev, F2 curr, F3 scale, const ScheduleParams& schedule = CurrentSchedule()) {
+	Halide::Func next;
+	Halide::Var x, y, m, xi, yi, xo, yo;
+
+	next(x, y, m) = scale(x, y, m) * (curr(x, y - 1, m) + curr(x - 1, y, m) + curr(x + 1, y, m) + curr(x, y + 1, m) - 4 * curr(x, y, m)) + 2 * curr(x, y, m) - prev(x, y, m);
+
+	Halide::Var tx, ty, nx, ny, ti, tm;
+	next.tile(x, y, tx, ty, nx, ny, schedule.blockSize, schedule.blockSize);
+	next.tile(nx, ny, xo, yo, xi, yi, schedule.tileWidth, schedule.tileHeight)
+		.vectorize(xi)
+		.unroll(yi);
+
+	// Run the blocks of every instance in parallel
+	next.fuse(tx, ty, ti);
+	next.fuse(ti, m, tm);
+	next.parallel(tm);
+
+	return next;
+}
+
+}
+
+#endif // HalideExamples_WavePropagator_h
@@ -1,6 +1,11 @@
 #include <Graphics.h>
 #include <Vec.h>
 #include <Random.h>
+#include <Gravity.h>
+#include <BufferPool.h>
+#include <CpuDispatch.h>
+#include <Telemetry.h>
+#include <ParticleOrder.h>
 
 using namespace Halide;
 
@@ -11,53 +16,16 @@ const float TIMESCALE = 1.0f;
 const float GRAVITY = 0.01f * TIMESCALE * TIMESCALE;
 const float FADE_BASE = 0.987f;
 const float FADE = 0.987f; // pow(FADE_BASE, TIMESCALE)
+const double STEPS_PER_SECOND = 120.0;
+// The pair loop is pure arithmetic, so use the fast reciprocal square root
+const MathPrecision PRECISION = PRECISION_FAST;
+// Keep particles in Hilbert order, so neighbours in space are neighbours in memory for the force
+// and splat passes. They are reordered when locality decays past REORDER_THRESHOLD times its
+// value after the last reorder.
+const SpaceFillingCurve CURVE = CURVE_HILBERT;
+const double REORDER_THRESHOLD = 1.5;
 // 
 
-template <typename INPUT>
-Func Gravity(INPUT input) {
-	Var i;
-	
-	// Compute the cumulative force on each particle
-	RDom j(0, input.width());
-	
-	// Compute the gravitational acceleration vector between a pair of
-	// particles
-	Vec x0(input(i, 0), input(i, 1), input(i, 2));
-	Vec x1(input(j, 0), input(j, 1), input(j, 2));
-	Vec dx = x1 - x0;
-	Expr r2 = dx.magnitudeSquared();
-	// Let r2 be no smaller than 1.0f, to avoid particles blasting off from each other when they
-	// get too close. This also avoids dividing by zero.
-	r2 = Halide::max(1.0f, r2);
-	Expr r = Halide::sqrt(r2);
-	Vec a = GRAVITY * input(j, 6) * dx / (r * r2);
-	
-	// Compute the cumulative force
-	Func cumulativeForce;
-	cumulativeForce(i) = Tuple(Halide::sum(a.x), Halide::sum(a.y), Halide::sum(a.z));
-
-	cumulativeForce.vectorize(i, 32);
-	cumulativeForce.compute_root();
-	
-	// Compute the updated positions
-	Func updated;
-	Var k;
-	updated(i, k) = 0.0f;
-	updated(i, 0) = input(i, 0) + input(i, 3);
-	updated(i, 1) = input(i, 1) + input(i, 4);
-	updated(i, 2) = input(i, 2) + input(i, 5);
-	updated(i, 3) = input(i, 3) + cumulativeForce(i)[0];
-	updated(i, 4) = input(i, 4) + cumulativeForce(i)[1];
-	updated(i, 5) = input(i, 5) + cumulativeForce(i)[2];
-	updated(i, 6) = input(i, 6);
-
-	for (int up = 0; up < 6; ++up) {
-		updated.update(up).vectorize(i, 32);
-	}
-	
-	return updated;
-}
-
 Func Renderer(Image<float>& particles, Image<float>& previmage, int width, int height) {
 	Func image;
 	Var x, y;
@@ -124,17 +92,40 @@ void RunDemo(int width, int height) {
 	
 	// Main loop
 	
-	Func grav = Gravity(oldparticles);
+	// The step also reduces telemetry of the state it steps, published for external monitors
+	Func telemetry;
+	Func grav = Gravity(oldparticles, GRAVITY, PRECISION, CurrentSchedule(), &telemetry);
+	Pipeline gravPipeline(std::vector<Func>{ grav, telemetry });
+	UseBufferPool(gravPipeline);
+	const int telemetryBlocks = (NUM_PARTICLES + GRAVITY_TELEMETRY_BLOCK - 1) / GRAVITY_TELEMETRY_BLOCK;
+	Buffer partialsbuff(type_of<float>(), telemetryBlocks, GRAVITY_TELEMETRY_COUNT);
+	Image<float> partials(partialsbuff);
+	TelemetryPublisher publisher("HalideExamples.Grav");
 	Func renderer = Renderer(oldparticles, previmage, width, height);
+	ParticleOrder particleOrder(NUM_PARTICLES, 7, CURVE);
+	particleOrder.setThreshold(REORDER_THRESHOLD);
 	int nframe = 0;
-	while (true) {
-		printf("%d\n", nframe++);
+	FrameScheduler scheduler(STEPS_PER_SECOND);
+	// The renderer fades the previous trail image into the next every step, so a frame shows the
+	// trails of all the substeps since the last one
+	auto step = [&]() {
+		++nframe;
 		renderer.realize(image);
-		DisplayImage(image);
-		grav.realize(newparticles);
+		gravPipeline.realize(Realization(std::vector<Buffer>{ newbuff, partialsbuff }));
+		publisher.publishAsync(partials, GRAVITY_TELEMETRY, GRAVITY_TELEMETRY_COUNT, nframe);
 		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
 		std::swap(*previmagebuff.raw_buffer(), *imagebuff.raw_buffer());
-	}
+		// newbuff is free until the next step, so it is the scratch for the reorder
+		particleOrder.update(oldbuff, newbuff);
+		if (Verbose() && nframe % 1000 == 0) {
+			BufferPool::shared().printStats();
+			printf("%d reorders\n", particleOrder.reorders());
+		}
+	};
+	auto render = [&]() {
+		DisplayImage(previmage);
+	};
+	scheduler.run(step, render);
 	
 }
 
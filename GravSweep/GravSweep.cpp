@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <Halide.h>
+#include <Random.h>
+#include <Gravity.h>
+#include <CpuDispatch.h>
+#include <ThreadPool.h>
+
+using namespace Halide;
+
+namespace HalideExamples {
+
+// A headless parameter sweep over the gravitational constant. Every instance is a Grav system of
+// the same size, and all of them are stepped together in one realize of GravityEnsemble, so a
+// sweep of small systems fills the machine from one process and one compile.
+const int NUM_PARTICLES = 512;
+const int DEFAULT_INSTANCES = 16;
+const int DEFAULT_STEPS = 1000;
+const float MIN_GRAVITY = 0.001f;
+const float MAX_GRAVITY = 0.05f;
+const int WIDTH = 1280;
+const int HEIGHT = 720;
+
+// Kinetic plus softened potential energy of instance m
+double Energy(Image<float>& particles, int m, float gravity) {
+	double kinetic = 0.0;
+	double potential = 0.0;
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		double mass = particles(i, 6, m);
+		kinetic += 0.5 * mass * (particles(i, 3, m) * particles(i, 3, m) + particles(i, 4, m) * particles(i, 4, m));
+		for (int j = i + 1; j < NUM_PARTICLES; ++j) {
+			double dx = particles(j, 0, m) - particles(i, 0, m);
+			double dy = particles(j, 1, m) - particles(i, 1, m);
+			double r = std::sqrt(std::max(1.0, dx * dx + dy * dy));
+			potential -= gravity * mass * particles(j, 6, m) / r;
+		}
+	}
+	return kinetic + potential;
+}
+
+void RunSweep(int instances, int steps) {
+	Buffer oldbuff(type_of<float>(), NUM_PARTICLES, 7, instances);
+	Buffer newbuff(type_of<float>(), NUM_PARTICLES, 7, instances);
+	Image<float> oldparticles(oldbuff);
+	Image<float> gravity(instances);
+
+	// Every instance starts from the same bodies, as in the Grav demo
+	std::srand(1);
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		float x = Random(0.0f, WIDTH - 1.0f);
+		float y = Random(0.0f, HEIGHT - 1.0f);
+		float vx = Random(-0.25f, 0.25f);
+		float vy = Random(-0.25f, 0.25f);
+		float mass = Random(0.1f, 1.0f);
+		for (int m = 0; m < instances; ++m) {
+			oldparticles(i, 0, m) = x;
+			oldparticles(i, 1, m) = y;
+			oldparticles(i, 2, m) = 0.0f;
+			oldparticles(i, 3, m) = vx;
+			oldparticles(i, 4, m) = vy;
+			oldparticles(i, 5, m) = 0.0f;
+			oldparticles(i, 6, m) = mass;
+		}
+	}
+	for (int m = 0; m < instances; ++m) {
+		float t = instances > 1 ? static_cast<float>(m) / (instances - 1) : 0.0f;
+		gravity(m) = MIN_GRAVITY * std::pow(MAX_GRAVITY / MIN_GRAVITY, t);
+	}
+	std::vector<double> initialEnergy(instances);
+	for (int m = 0; m < instances; ++m) {
+		initialEnergy[m] = Energy(oldparticles, m, gravity(m));
+	}
+
+	Func ens = GravityEnsemble(oldparticles, gravity);
+	UseThreadPool(ens);
+	Target target = CompileForIsa(ens);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int step = 0; step < steps; ++step) {
+		ens.realize(newbuff, target);
+		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::printf("%d instances of %d bodies, %d steps: %.3f ms/step (%s)\n",
+				instances, NUM_PARTICLES, steps, ms / steps, IsaName(CurrentIsa()));
+
+	// Image caches its host pointer, so view the swapped buffer through a fresh one
+	Image<float> result(oldbuff);
+	std::printf("%10s %16s %16s\n", "gravity", "energy", "drift");
+	for (int m = 0; m < instances; ++m) {
+		double energy = Energy(result, m, gravity(m));
+		std::printf("%10.5f %16.6f %16.3e\n", gravity(m), energy,
+					(energy - initialEnergy[m]) / std::max(1e-12, std::fabs(initialEnergy[m])));
+	}
+}
+
+}
+
+using namespace HalideExamples;
+
+// Usage: GravSweep [instances] [steps] [--isa=<name>]
+int main(int argc, char** argv) {
+	SelectIsa(argc, argv);
+	int instances = DEFAULT_INSTANCES;
+	int steps = DEFAULT_STEPS;
+	int positional = 0;
+	for (int a = 1; a < argc; ++a) {
+		if (argv[a][0] == '-') {
+			continue;
+		}
+		int value = std::atoi(argv[a]);
+		if (value > 0 && positional == 0) {
+			instances = value;
+		} else if (value > 0 && positional == 1) {
+			steps = value;
+		}
+		++positional;
+	}
+	RunSweep(instances, steps);
+	return 0;
+}
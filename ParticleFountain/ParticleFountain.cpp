@@ -1,100 +1,155 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <vector>
 
 #include <Halide.h>
 #include <Graphics.h>
 #include <Vec.h>
+#include <ParticleFountain.h>
+#include <BufferPool.h>
+#include <StreamCompaction.h>
+#include <SpatialGrid.h>
+#include <ThreadPool.h>
 
 using namespace Halide;
 
 namespace HalideExamples {
 
-const int NUM_PARTICLES = 100000;
+const int NUM_PARTICLES = 102400;			// capacity of the particle state, a multiple of 1024
+const int EMISSION_RATE = 1000;				// new particles per step, a multiple of 8
+const float MIN_LIFE = 50.0f;				// lifetime range, in steps
+const float MAX_LIFE = 150.0f;
+const int NUM_STEPS = 1000;
 const float TIMESCALE = 0.001f;
 const float GRAVITY = 1.0f * TIMESCALE;
+const float COLLISION_DISTANCE = 2.0f;		// particles closer than this push each other apart
+const float COLLISION_STIFFNESS = 0.1f * TIMESCALE;
 
-/////////////////// PARTICLE FOUNTAIN FUNCTION ////////////////////
-
-template <typename F1>
-Func ParticleFountain(F1 particles, Param<float> gravity) {
-	////////////////////////// ALGORITHM //////////////////////////
-
-	Func output;
-	Var x;
-	
-	// adjust Y velocity
-	Expr vely = particles(x, 3) + gravity;
-	// move the particle
-	output(x) = Tuple(particles(x, 0) + particles(x, 2),
-					  particles(x, 1) + vely,
-					  vely);
-
-	////////////////////////// SCHEDULE //////////////////////////
-	output.vectorize(x, 32);
-	
-	return output;
-}
-
-void InitPlane(buffer_t& buff, Buffer& particleBuff, int plane) {
+// Point buff at elements [min, min + extent) of one plane of particleBuff
+void InitPlane(buffer_t& buff, Buffer& particleBuff, int plane, int min, int extent) {
 	buffer_t* rawParticleBuff = particleBuff.raw_buffer();
-	buff.host = rawParticleBuff->host + rawParticleBuff->stride[1] * plane;
-	buff.extent[0] = rawParticleBuff->extent[0];
+	buff.host = rawParticleBuff->host + (rawParticleBuff->stride[1] * plane + rawParticleBuff->stride[0] * min) * rawParticleBuff->elem_size;
+	buff.min[0] = min;
+	buff.extent[0] = extent;
 	buff.extent[1] = 0;
 	buff.stride[0] = rawParticleBuff->stride[0];
 	buff.stride[1] = rawParticleBuff->stride[1];
 	buff.elem_size = rawParticleBuff->elem_size;
 }
 
-float Random(float min, float max) {
-	int ix = std::rand() & 0xFFFFF;
-	float x = static_cast<float>(ix) / 0xFFFFF;
-	return x * (max - min) + min;
-}
-
-void CreateParticle(Image<float>& particles, Image<float>& newParticles, int i) {
-	// The particles get launched with random directions and speeds from the bottom of the image
-	float vel = TIMESCALE * (Random(10.0f, 100.0f) + Random(10.0f, 100.0f) + Random(10.0f, 100.0f));
-	float angle = Random(M_PI / 4.0f, 3.0f * M_PI / 4.0f);
-	newParticles(i, 0) = particles(i, 0) = SCREEN_WIDTH / 2;
-	newParticles(i, 1) = particles(i, 1) = SCREEN_HEIGHT - 1;
-	newParticles(i, 2) = particles(i, 2) = vel * std::cos(angle);
-	newParticles(i, 3) = particles(i, 3) = -vel * std::sin(angle); // negative direction to go upward
+const float* PlaneData(Buffer& particleBuff, int plane) {
+	buffer_t* raw = particleBuff.raw_buffer();
+	return reinterpret_cast<const float*>(raw->host) + raw->stride[1] * plane;
 }
 
 ////////////////////////// MAIN DEMO FUNCTION //////////////////////////
 
 void RunDemo(int width, int height) {
-	// Main buffer which holds the 
-	Buffer buff1(type_of<float>(), NUM_PARTICLES, 4);
-	Image<float> particles(buff1);
-	Buffer buff2(type_of<float>(), NUM_PARTICLES, 4);
-	Image<float> newparticles(buff2);
-	
-	// Initialize the particles
-	for (int i = 0; i < NUM_PARTICLES; ++i) {
-		CreateParticle(particles, newparticles, i);
-	}
-	
+	// The live particles, always packed at the front of the buffer
+	Buffer statebuff(type_of<float>(), NUM_PARTICLES, PARTICLE_PLANES);
+	Image<float> particles(statebuff);
+	int live = 0;
+
+	// Output of each step, before dead particles are removed
+	Buffer steppedbuff(type_of<float>(), NUM_PARTICLES, PARTICLE_PLANES);
+	Buffer alivebuff(type_of<uint8_t>(), NUM_PARTICLES);
+
 	Param<float> deltaz;
 	deltaz.set(GRAVITY);
-	Func par = ParticleFountain(particles, deltaz);
-
-	for (int i = 0; i < 100; ++i) {
-		printf("%f,%f,%f,%f\n", particles(0, 0), particles(0, 1), particles(0, 2), particles(0, 3));
-		// Make buffers for the X, Y, velY planes
-		buffer_t xbuff = { 0 };
-		InitPlane(xbuff, buff2, 0);
-		buffer_t ybuff = { 0 };
-		InitPlane(ybuff, buff2, 1);
-		buffer_t velybuff = { 0 };
-		InitPlane(velybuff, buff2, 3);
-		
-		Buffer x(type_of<float>(), &xbuff);
-		Buffer y(type_of<float>(), &ybuff);
-		Buffer vely(type_of<float>(), &velybuff);
-		
-		par.realize({x, y, vely});
-		std::swap(*buff1.raw_buffer(), *buff2.raw_buffer());
+	Func par = ParticleFountain(particles, deltaz, width, height);
+	UseThreadPool(par);
+
+	Param<int> seed;
+	Func emitter = ParticleEmitter(seed, width / 2, height - 1, TIMESCALE, MIN_LIFE, MAX_LIFE);
+
+	// Neighbour search grid, with cells as large as the collision distance. The cell-sorted copy
+	// of the particles goes into the stepped buffer, which is free by then.
+	int gridWidth = static_cast<int>(std::ceil(width / COLLISION_DISTANCE));
+	int gridHeight = static_cast<int>(std::ceil(height / COLLISION_DISTANCE));
+	SpatialGrid grid(gridWidth, gridHeight);
+	Buffer keysbuff(type_of<int32_t>(), NUM_PARTICLES);
+	Func keys = ParticleCellKeys(particles, COLLISION_DISTANCE, gridWidth, gridHeight);
+	UseThreadPool(keys);
+	Func collisions = ParticleCollisions(Image<float>(steppedbuff), grid.cellStarts(), COLLISION_DISTANCE,
+										 gridWidth, gridHeight, COLLISION_DISTANCE, COLLISION_STIFFNESS);
+	UseThreadPool(collisions);
+	UseBufferPool(collisions);
+
+	// Make buffers for the planes once, and point them at the live or free range of the state on
+	// each step instead of allocating new wrappers
+	buffer_t planebuff = { 0 };
+	std::vector<Buffer> steppedPlanes;
+	std::vector<Buffer> emittedPlanes;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		steppedPlanes.push_back(Buffer(type_of<float>(), &planebuff));
+		emittedPlanes.push_back(Buffer(type_of<float>(), &planebuff));
+	}
+	buffer_t alive = *alivebuff.raw_buffer();
+	steppedPlanes.push_back(Buffer(type_of<uint8_t>(), &alive));
+	std::vector<Buffer> collidedPlanes;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		collidedPlanes.push_back(Buffer(type_of<float>(), &planebuff));
+	}
+	buffer_t keysraw = *keysbuff.raw_buffer();
+	Buffer keysout(type_of<int32_t>(), &keysraw);
+
+	std::vector<const float*> compactFrom;
+	std::vector<float*> compactTo;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		compactFrom.push_back(PlaneData(steppedbuff, p));
+		compactTo.push_back(const_cast<float*>(PlaneData(statebuff, p)));
+	}
+	const uint8_t* mask = alivebuff.raw_buffer()->host;
+
+	std::vector<const float*> sortFrom;
+	std::vector<float*> sortTo;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		sortFrom.push_back(PlaneData(statebuff, p));
+		sortTo.push_back(const_cast<float*>(PlaneData(steppedbuff, p)));
+	}
+	const int32_t* keyData = reinterpret_cast<const int32_t*>(keysbuff.raw_buffer()->host);
+
+	for (int i = 0; i < NUM_STEPS; ++i) {
+		// Step the live particles and pack the survivors back into the state
+		if (live > 0) {
+			// Round up to whole blocks; the extra slots are stepped but never kept
+			int extent = (live + 1023) / 1024 * 1024;
+			for (int p = 0; p < PARTICLE_PLANES; ++p) {
+				InitPlane(*steppedPlanes[p].raw_buffer(), steppedbuff, p, 0, extent);
+			}
+			steppedPlanes[PARTICLE_PLANES].raw_buffer()->extent[0] = extent;
+			par.realize(Realization(steppedPlanes));
+			live = CompactPlanes(compactFrom, compactTo, mask, live);
+		}
+
+		// Respawn into the freed slots, in whole vectors
+		int emit = std::min(EMISSION_RATE, NUM_PARTICLES - live) / 8 * 8;
+		if (emit > 0) {
+			for (int p = 0; p < PARTICLE_PLANES; ++p) {
+				InitPlane(*emittedPlanes[p].raw_buffer(), statebuff, p, live, emit);
+			}
+			seed.set(i);
+			emitter.realize(Realization(emittedPlanes));
+			live += emit;
+		}
+
+		// Sort the particles by cell and push overlapping ones apart. The collided particles are
+		// written back in cell order, so neighbours stay close in memory from step to step.
+		if (live > 0) {
+			int extent = (live + 1023) / 1024 * 1024;
+			keysout.raw_buffer()->extent[0] = extent;
+			keys.realize(keysout);
+			grid.sort(keyData, sortFrom, sortTo, live);
+			for (int p = 0; p < PARTICLE_PLANES; ++p) {
+				InitPlane(*collidedPlanes[p].raw_buffer(), statebuff, p, 0, extent);
+			}
+			collisions.realize(Realization(collidedPlanes));
+		}
+
+		if (Verbose()) {
+			printf("%d: %d live\n", i, live);
+		}
 	}
 }
 
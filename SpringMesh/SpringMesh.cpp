@@ -1,6 +1,12 @@
+#include <memory>
+
 #include <Graphics.h>
 #include <Vec.h>
 #include <Random.h>
+#include <SpringMesh.h>
+#include <ImplicitSpringMesh.h>
+#include <SpringNetwork.h>
+#include <Telemetry.h>
 
 using namespace Halide;
 
@@ -13,62 +19,26 @@ const float SPRING_FORCE = 0.3f;
 const float GRAVITY = 0.0001f;
 //const float GRAVITY = 0.0f;
 const float FADE = 0.977f;
-const float ROOT2 = 1.4142135623f;
 const float DEGREES_TO_RADS = 0.0174532925199f;
+// How to step the mesh: the explicit grid kernel, backward Euler with each implicit step worth
+// IMPLICIT_TIMESTEP explicit steps, or the explicit kernel on the mesh loaded as a
+// general spring network with its nodes in scrambled order
+enum StepMode { STEP_EXPLICIT, STEP_IMPLICIT, STEP_NETWORK };
+const StepMode MODE = STEP_IMPLICIT;
+const float IMPLICIT_TIMESTEP = 10.0f;
+// Explicit steps per second of simulated time; the frame scheduler takes as many substeps per frame
+// as that calls for and the machine can afford
+const double STEPS_PER_SECOND = 600.0;
+// Precision of the explicit spring kernels
+const MathPrecision PRECISION = PRECISION_FAST;
 
-Vec SpringForce(const Vec& r0, const Vec& r1) {
-	Vec dr = r1 - r0;
-	Expr len = dr.magnitude();
-	Expr f = (len - SPRING_REST_LENGTH) * SPRING_FORCE;
-	return f * dr / len;
-}
-
-template <typename INPUT, typename COORD>
-Vec SpringForce(INPUT& input, COORD& x, COORD& y, Expr dx, Expr dy, float scale=1.0f) {
-	Vec r0(input(x, y, 0), input(x, y, 1), 0.0f);
-	Expr x1 = clamp(x + dx, 0, input.width() - 1);
-	Expr y1 = clamp(y + dy, 0, input.height() - 1);
-	Vec r1(input(x1, y1, 0), input(x1, y1, 1), 0.0f);
-	Vec dr = r1 - r0;
-	Expr len = dr.magnitude();
-	Vec f = (len - scale * SPRING_REST_LENGTH) * SPRING_FORCE * dr / len;
-	Expr outx = select(x1 == x + dx && y1 == y + dy, f.x, 0.0f);
-	Expr outy = select(x1 == x + dx && y1 == y + dy, f.y, 0.0f);
-	return Vec(outx, outy, 0);
-}
-
-template <typename INPUT>
-Func SpringMesh(INPUT input) {
-	Func output;
-	Var x, y, z;
-	output(x, y, z) = input(x, y, z);
-
-	Vec f = SpringForce(input, x, y,  0, -1)
-		  + SpringForce(input, x, y, -1,  0)
-		  + SpringForce(input, x, y,  1,  0)
-		  + SpringForce(input, x, y,  0,  1)
-		  + SpringForce(input, x, y, -1, -1, ROOT2)
-		  + SpringForce(input, x, y, -1,  1, ROOT2)
-		  + SpringForce(input, x, y,  1, -1, ROOT2)
-		  + SpringForce(input, x, y,  1,  1, ROOT2);
-	output(x, y, 0) = input(x, y, 0) + input(x, y, 2) + f.x;
-	output(x, y, 1) = input(x, y, 1) + input(x, y, 3) + f.y + GRAVITY;
-	output(x, y, 2) = input(x, y, 2) + f.x;
-	output(x, y, 3) = input(x, y, 3) + f.y + GRAVITY;
-	
-	Var xo, yo, xi, yi;
-	output.tile(x, y, xo, yo, xi, yi, 32, 8).vectorize(xi).unroll(yi);
-	
-	// We'll deal with the edge cases later
-	return output;
-}
-
-Func Renderer(Image<float>& particles, Image<float>& previmage, int width, int height) {
+// particles(x, y, plane) holds the mass points on a countx x county grid
+Func Renderer(Func particles, int countx, int county, Image<float>& previmage, int width, int height) {
 	Func image;
 	Var x, y;
 	
 	image(x, y) = FADE * previmage(x, y);
-	RDom i(0, particles.width(), 0, particles.height());
+	RDom i(0, countx, 0, county);
 	
 	Expr posx = clamp(cast<int>(particles(i.x, i.y, 0) + 0.5f), 0.0f, static_cast<float>(width - 1));
 	Expr posy = clamp(cast<int>(particles(i.x, i.y, 1) + 0.5f), 0.0f, static_cast<float>(height - 1));
@@ -79,11 +49,27 @@ Func Renderer(Image<float>& particles, Image<float>& previmage, int width, int h
 	return image;
 }
 	
+// Let particles bounce off the bottom. Works on both the grid and network layouts, which keep
+// y position and velocity in planes 1 and 3.
+void Bounce(Image<float>& particles, int height) {
+	int countx = particles.width();
+	int county = particles.dimensions() == 3 ? particles.height() : 1;
+	for (int j = 0; j < county; ++j) {
+		for (int i = 0; i < countx; ++i) {
+			float& py = particles.dimensions() == 3 ? particles(i, j, 1) : particles(i, 1);
+			float& vy = particles.dimensions() == 3 ? particles(i, j, 3) : particles(i, 3);
+			if (py >= height - 1) {
+				py = 2 * (height - 1) - py;
+				vy = -vy;
+			}
+		}
+	}
+}
+
 void RunDemo(int width, int height) {
 	Buffer oldbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
 	Buffer newbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
 	Image<float> oldparticles(oldbuff);
-	Image<float> newparticles(newbuff);
 	
 	Buffer previmagebuff(type_of<float>(), width, height);
 	Buffer imagebuff(type_of<float>(), width, height);
@@ -134,29 +120,86 @@ void RunDemo(int width, int height) {
 	
 	// Main loop
 	
-	Func spring = SpringMesh(oldparticles);
-	Func renderer = Renderer(oldparticles, previmage, width, height);
+	// Telemetry of the mesh is published for external monitors. The explicit step realizes it
+	// alongside the update, and the implicit solver accumulates it while moving the mesh.
+	Func telemetry;
+	Func spring = SpringMesh(oldparticles, SPRING_FORCE, SPRING_REST_LENGTH, GRAVITY, PRECISION, &telemetry);
+	Pipeline springPipeline(std::vector<Func>{ spring, telemetry });
+	Buffer partialsbuff(type_of<float>(), MESH_HEIGHT, SPRING_MESH_TELEMETRY_COUNT);
+	Image<float> partials(partialsbuff);
+	TelemetryPublisher publisher("HalideExamples.SpringMesh");
+	ImplicitSpringMesh implicit(MESH_WIDTH, MESH_HEIGHT, SPRING_FORCE, SPRING_REST_LENGTH, GRAVITY, IMPLICIT_TIMESTEP);
+
+	// Network state is one plane per quantity, in network node order. The network is the mesh
+	// loaded with its nodes in scrambled order, then reordered; it is only built in network mode.
+	const int nodes = MESH_WIDTH * MESH_HEIGHT;
+	std::unique_ptr<SpringNetwork> network;
+	Buffer oldnetbuff;
+	Buffer newnetbuff;
+	Image<float> oldnodes;
+	Func networkStep;
+	if (MODE == STEP_NETWORK) {
+		std::vector<int> gridIndex;
+		network.reset(new SpringNetwork(GridSpringNetwork(MESH_WIDTH, MESH_HEIGHT, SPRING_REST_LENGTH, gridIndex)));
+		int shuffledBandwidth = network->bandwidth();
+		network->reorder();
+		if (Verbose()) {
+			printf("network bandwidth %d, %d after reordering\n", shuffledBandwidth, network->bandwidth());
+		}
+		oldnetbuff = Buffer(type_of<float>(), nodes, 4);
+		newnetbuff = Buffer(type_of<float>(), nodes, 4);
+		oldnodes = Image<float>(oldnetbuff);
+		for (int i = 0; i < nodes; ++i) {
+			int g = gridIndex[network->permutation()[i]];
+			for (int z = 0; z < 4; ++z) {
+				oldnodes(i, z) = oldparticles(g % MESH_WIDTH, g / MESH_WIDTH, z);
+			}
+		}
+		networkStep = SpringNetworkStep(oldnodes, network->offsets(), network->neighbours(), network->restLengths(),
+										network->maxDegree(), SPRING_FORCE, GRAVITY, PRECISION);
+	}
+
+	Var x, y, z;
+	Func particles;
+	if (MODE == STEP_NETWORK) {
+		particles(x, y, z) = oldnodes(x, z);
+	} else {
+		particles(x, y, z) = oldparticles(x, y, z);
+	}
+	Func renderer = MODE == STEP_NETWORK ? Renderer(particles, nodes, 1, previmage, width, height)
+										 : Renderer(particles, MESH_WIDTH, MESH_HEIGHT, previmage, width, height);
 	int nframe = 0;
 	float period = 70.0f;
-	while (true) {
-		printf("%d\n", nframe++);
+	FrameScheduler scheduler(MODE == STEP_IMPLICIT ? STEPS_PER_SECOND / IMPLICIT_TIMESTEP : STEPS_PER_SECOND);
+	auto step = [&]() {
+		++nframe;
 		renderer.realize(image);
-		if (nframe % 10 == 0) {
-			DisplayImage(image);
-		}
-		spring.realize(newparticles);
-		// Let particles bounce off the bottom
-		for (int y = 0; y < MESH_WIDTH; ++y) {
-			for (int x = 0; x < MESH_HEIGHT; ++x) {
-				if (newparticles(x, y, 1) >= height - 1) {
-					newparticles(x, y, 1) = 2 * (height - 1) - newparticles(x, y, 1);
-					newparticles(x, y, 3) = -newparticles(x, y, 3);
-				}
+		if (MODE == STEP_IMPLICIT) {
+			// Steps in place
+			ImplicitSpringMesh::SolveStats stats = implicit.step(oldparticles, &partials);
+			if (Verbose()) {
+				printf("  %d iterations, residual %g\n", stats.iterations, stats.residual);
 			}
+			Bounce(oldparticles, height);
+			publisher.publishAsync(partials, SPRING_MESH_TELEMETRY, SPRING_MESH_TELEMETRY_COUNT, nframe);
+		} else if (MODE == STEP_NETWORK) {
+			networkStep.realize(newnetbuff);
+			Image<float> newnodes(newnetbuff);
+			Bounce(newnodes, height);
+			std::swap(*oldnetbuff.raw_buffer(), *newnetbuff.raw_buffer());
+		} else {
+			springPipeline.realize(Realization(std::vector<Buffer>{ newbuff, partialsbuff }));
+			publisher.publishAsync(partials, SPRING_MESH_TELEMETRY, SPRING_MESH_TELEMETRY_COUNT, nframe);
+			Image<float> newmesh(newbuff);
+			Bounce(newmesh, height);
+			std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
 		}
-		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
 		std::swap(*previmagebuff.raw_buffer(), *imagebuff.raw_buffer());
-	}
+	};
+	auto render = [&]() {
+		DisplayImage(previmage);
+	};
+	scheduler.run(step, render);
 	
 }
 
@@ -0,0 +1,41 @@
+#include <cstring>
+
+#include <BufferPool.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+
+// Allocate and free one "frame" worth of intermediates of assorted sizes
+void Frame(BufferPool& pool, TestCase& test) {
+	const size_t sizes[] = { 4, 100, 4096, 65536, 3 << 20, 64 << 20 };
+	void* blocks[6];
+	for (int i = 0; i < 6; ++i) {
+		blocks[i] = pool.allocate(sizes[i]);
+		test.expect("allocation failed", blocks[i] != 0);
+		test.expect("allocation is not 64-byte aligned", reinterpret_cast<uintptr_t>(blocks[i]) % 64 == 0);
+		std::memset(blocks[i], i, sizes[i]);
+	}
+	for (int i = 5; i >= 0; --i) {
+		pool.free(blocks[i]);
+	}
+}
+
+int main() {
+	TestCase test("BufferPool");
+	BufferPool pool;
+
+	Frame(pool, test);
+	BufferPool::Stats first = pool.stats();
+
+	for (int frame = 0; frame < 100; ++frame) {
+		Frame(pool, test);
+	}
+	BufferPool::Stats steady = pool.stats();
+
+	test.expect("steady-state frames made system allocations", steady.systemAllocations == first.systemAllocations);
+	test.expect("steady-state frames missed the pool", steady.poolHits - first.poolHits == 600);
+	test.expect("blocks leaked", steady.bytesInUse == 0);
+
+	return test.result();
+}
@@ -0,0 +1,55 @@
+#include <FramePacer.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+
+int main() {
+	TestCase test("FramePacer");
+
+	// Unpaced, a frame takes one step until the cost of a step has been measured, then as many as
+	// fit in the frame
+	FramePacer unpaced(0.0, 16.5);
+	test.expect("unmeasured step did not take the whole frame", unpaced.substeps(0.0) == 1);
+	for (int i = 0; i < 200; ++i) {
+		unpaced.recordStep(1.0);
+	}
+	test.expectNear("smoothed step cost", unpaced.stepMs(), 1.0, 1e-6);
+	test.expect("unpaced frame did not fill with steps", unpaced.substeps(0.0) == 16);
+
+	// Rendering takes its share of the frame first, but a frame always steps once
+	for (int i = 0; i < 200; ++i) {
+		unpaced.recordRender(12.0);
+	}
+	test.expect("render cost was not taken from the step budget", unpaced.substeps(0.0) == 4);
+	for (int i = 0; i < 200; ++i) {
+		unpaced.recordRender(20.0);
+	}
+	test.expect("frame over budget did not step once", unpaced.substeps(0.0) == 1);
+
+	// Paced, steps accumulate against the wall clock, carrying fractions of a step between frames
+	FramePacer paced(30.0, 1000.0 / 60.0);
+	for (int i = 0; i < 200; ++i) {
+		paced.recordStep(0.1);
+	}
+	int total = 0;
+	bool alternates = true;
+	for (int frame = 0; frame < 60; ++frame) {
+		int substeps = paced.substeps(1.0 / 60.0);
+		alternates = alternates && substeps == frame % 2;
+		total += substeps;
+	}
+	test.expect("paced steps did not alternate between frames", alternates);
+	test.expect("paced steps did not keep up with the clock", total == 30);
+
+	// A kernel too slow for the rate is capped at what fits, and the time it falls behind is
+	// dropped rather than made up later
+	FramePacer slow(1000.0, 16.5);
+	for (int i = 0; i < 200; ++i) {
+		slow.recordStep(5.0);
+	}
+	test.expect("slow kernel was not capped to the frame", slow.substeps(1.0 / 60.0) == 3);
+	test.expect("slow kernel carried its backlog into the next frame", slow.substeps(0.0) == 0);
+
+	return test.result();
+}
@@ -0,0 +1,267 @@
+#include <vector>
+
+#include <Gravity.h>
+#include <ParticleOrder.h>
+#include <Random.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+using namespace Halide;
+
+const int NUM_PARTICLES = 256;
+const int INSTANCES = 3;
+const int STEPS = 20;
+const float GRAVITY = 0.01f;
+const int ENERGY_STEPS = 200;
+
+// Random particles in a 1280x720 box, as in the Grav demo
+void InitializeParticles(Image<float>& particles, int m) {
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		particles(i, 0, m) = Random(0.0f, 1279.0f);
+		particles(i, 1, m) = Random(0.0f, 719.0f);
+		particles(i, 2, m) = 0.0f;
+		particles(i, 3, m) = Random(-0.25f, 0.25f);
+		particles(i, 4, m) = Random(-0.25f, 0.25f);
+		particles(i, 5, m) = 0.0f;
+		particles(i, 6, m) = Random(0.1f, 1.0f);
+	}
+}
+
+// Scalar step matching Gravity. state holds 7 planes of NUM_PARTICLES values.
+void ReferenceStep(std::vector<float>& state, float gravity) {
+	std::vector<float> next(state);
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		float ax = 0.0f, ay = 0.0f, az = 0.0f;
+		for (int j = 0; j < NUM_PARTICLES; ++j) {
+			float dx = state[0 * NUM_PARTICLES + j] - state[0 * NUM_PARTICLES + i];
+			float dy = state[1 * NUM_PARTICLES + j] - state[1 * NUM_PARTICLES + i];
+			float dz = state[2 * NUM_PARTICLES + j] - state[2 * NUM_PARTICLES + i];
+			float r2 = std::max(1.0f, dx * dx + dy * dy + dz * dz);
+			float k = gravity * state[6 * NUM_PARTICLES + j] / (std::sqrt(r2) * r2);
+			ax += k * dx;
+			ay += k * dy;
+			az += k * dz;
+		}
+		for (int d = 0; d < 3; ++d) {
+			next[d * NUM_PARTICLES + i] = state[d * NUM_PARTICLES + i] + state[(d + 3) * NUM_PARTICLES + i];
+		}
+		next[3 * NUM_PARTICLES + i] += ax;
+		next[4 * NUM_PARTICLES + i] += ay;
+		next[5 * NUM_PARTICLES + i] += az;
+	}
+	state.swap(next);
+}
+
+double MaxError(Image<float>& particles, int m, const std::vector<float>& state) {
+	double error = 0.0;
+	for (int k = 0; k < 7; ++k) {
+		for (int i = 0; i < NUM_PARTICLES; ++i) {
+			double expected = state[k * NUM_PARTICLES + i];
+			double scale = std::max(1.0, std::fabs(expected));
+			error = std::max(error, std::fabs(particles(i, k, m) - expected) / scale);
+		}
+	}
+	return error;
+}
+
+// Kinetic plus softened potential energy of a single system
+double Energy(Image<float>& particles, float gravity) {
+	double kinetic = 0.0;
+	double potential = 0.0;
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		double mass = particles(i, 6);
+		kinetic += 0.5 * mass * (particles(i, 3) * particles(i, 3) + particles(i, 4) * particles(i, 4) + particles(i, 5) * particles(i, 5));
+		for (int j = i + 1; j < NUM_PARTICLES; ++j) {
+			double dx = particles(j, 0) - particles(i, 0);
+			double dy = particles(j, 1) - particles(i, 1);
+			double dz = particles(j, 2) - particles(i, 2);
+			double r = std::sqrt(std::max(1.0, dx * dx + dy * dy + dz * dz));
+			potential -= gravity * mass * particles(j, 6) / r;
+		}
+	}
+	return kinetic + potential;
+}
+
+// Run a system for ENERGY_STEPS steps at the given precision and return its final energy
+double FinalEnergy(MathPrecision precision, double& msPerStep) {
+	std::srand(TEST_SEED);
+	Buffer oldbuff(type_of<float>(), NUM_PARTICLES, 7);
+	Buffer newbuff(type_of<float>(), NUM_PARTICLES, 7);
+	Image<float> particles(oldbuff);
+	InitializeParticles(particles, 0);
+	Func grav = Gravity(particles, GRAVITY, precision);
+	grav.compile_jit();
+	Timer timer;
+	for (int step = 0; step < ENERGY_STEPS; ++step) {
+		grav.realize(newbuff);
+		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
+	}
+	msPerStep = timer.elapsedMs() / ENERGY_STEPS;
+	Image<float> result(oldbuff);
+	return Energy(result, GRAVITY);
+}
+
+int main() {
+	TestCase test("Gravity");
+
+	// Single system against the scalar reference
+	Buffer oldbuff(type_of<float>(), NUM_PARTICLES, 7);
+	Buffer newbuff(type_of<float>(), NUM_PARTICLES, 7);
+	Image<float> oldparticles(oldbuff);
+	Image<float> newparticles(newbuff);
+	InitializeParticles(oldparticles, 0);
+
+	std::vector<float> state(7 * NUM_PARTICLES);
+	for (int k = 0; k < 7; ++k) {
+		for (int i = 0; i < NUM_PARTICLES; ++i) {
+			state[k * NUM_PARTICLES + i] = oldparticles(i, k);
+		}
+	}
+
+	Func grav = Gravity(oldparticles, GRAVITY);
+	grav.compile_jit();
+	double totalMs = 0.0;
+	for (int step = 0; step < STEPS; ++step) {
+		Timer timer;
+		grav.realize(newparticles);
+		totalMs += timer.elapsedMs();
+		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
+		ReferenceStep(state, GRAVITY);
+	}
+	// Image caches its host pointer, so view the swapped buffer through a fresh one
+	Image<float> result(oldbuff);
+	test.expectNear("max relative error against reference", MaxError(result, 0, state), 0.0, 1e-3);
+
+	// Ensemble: each instance has its own gravitational constant
+	Buffer oldens(type_of<float>(), NUM_PARTICLES, 7, INSTANCES);
+	Buffer newens(type_of<float>(), NUM_PARTICLES, 7, INSTANCES);
+	Image<float> oldensemble(oldens);
+	Image<float> newensemble(newens);
+	Image<float> gravity(INSTANCES);
+	std::vector<std::vector<float> > states(INSTANCES, std::vector<float>(7 * NUM_PARTICLES));
+	for (int m = 0; m < INSTANCES; ++m) {
+		InitializeParticles(oldensemble, m);
+		gravity(m) = GRAVITY * (m + 1);
+		for (int k = 0; k < 7; ++k) {
+			for (int i = 0; i < NUM_PARTICLES; ++i) {
+				states[m][k * NUM_PARTICLES + i] = oldensemble(i, k, m);
+			}
+		}
+	}
+
+	Func ens = GravityEnsemble(oldensemble, gravity);
+	for (int step = 0; step < STEPS; ++step) {
+		ens.realize(newensemble);
+		std::swap(*oldens.raw_buffer(), *newens.raw_buffer());
+	}
+	Image<float> ensResult(oldens);
+	for (int m = 0; m < INSTANCES; ++m) {
+		for (int step = 0; step < STEPS; ++step) {
+			ReferenceStep(states[m], GRAVITY * (m + 1));
+		}
+		test.expectNear("ensemble max relative error against reference", MaxError(ensResult, m, states[m]), 0.0, 1e-3);
+	}
+
+	// Fast math: the energy of the fast path stays close to the exact path's
+	std::srand(TEST_SEED);
+	Image<float> initial(NUM_PARTICLES, 7);
+	InitializeParticles(initial, 0);
+	double initialEnergy = Energy(initial, GRAVITY);
+	double exactMs = 0.0;
+	double fastMs = 0.0;
+	double exactEnergy = FinalEnergy(PRECISION_EXACT, exactMs);
+	double fastEnergy = FinalEnergy(PRECISION_FAST, fastMs);
+	std::printf("Gravity: exact %.4f ms/step, fast %.4f ms/step\n", exactMs, fastMs);
+	test.expect("fast math energy drift against exact path within 0.1%",
+				std::fabs(fastEnergy - exactEnergy) <= 1e-3 * std::fabs(initialEnergy));
+
+	// Telemetry partials, realized alongside the step, reduce to the scalar totals of the input state
+	std::srand(TEST_SEED);
+	Buffer telemetrybuff(type_of<float>(), NUM_PARTICLES, 7);
+	Buffer steppedbuff(type_of<float>(), NUM_PARTICLES, 7);
+	Image<float> telemetryState(telemetrybuff);
+	InitializeParticles(telemetryState, 0);
+	Func telemetry;
+	Func stepped = Gravity(telemetryState, GRAVITY, PRECISION_EXACT, CurrentSchedule(), &telemetry);
+	const int blocks = (NUM_PARTICLES + GRAVITY_TELEMETRY_BLOCK - 1) / GRAVITY_TELEMETRY_BLOCK;
+	Buffer partialsbuff(type_of<float>(), blocks, GRAVITY_TELEMETRY_COUNT);
+	Pipeline pipeline(std::vector<Func>{ stepped, telemetry });
+	pipeline.realize(Realization(std::vector<Buffer>{ steppedbuff, partialsbuff }));
+	Image<float> partials(partialsbuff);
+	TelemetrySnapshot snapshot;
+	snapshot.count = 0;
+	ReducePartials(partials, GRAVITY_TELEMETRY, GRAVITY_TELEMETRY_COUNT, snapshot);
+
+	double kinetic = 0.0, momentumX = 0.0, minX = 1e30, maxY = -1e30;
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		double mass = telemetryState(i, 6);
+		kinetic += 0.5 * mass * (telemetryState(i, 3) * telemetryState(i, 3) + telemetryState(i, 4) * telemetryState(i, 4) +
+							  telemetryState(i, 5) * telemetryState(i, 5));
+		momentumX += mass * telemetryState(i, 3);
+		minX = std::min(minX, static_cast<double>(telemetryState(i, 0)));
+		maxY = std::max(maxY, static_cast<double>(telemetryState(i, 1)));
+	}
+	double potential = Energy(telemetryState, GRAVITY) - kinetic;
+	test.expectNear("telemetry kinetic energy", snapshot.values[0], kinetic, 1e-4);
+	test.expectNear("telemetry potential energy", snapshot.values[1], potential, 1e-4);
+	test.expectNear("telemetry momentum", snapshot.values[2], momentumX, 1e-4);
+	test.expectNear("telemetry min x", snapshot.values[5], minX, 1e-6);
+	test.expectNear("telemetry max y", snapshot.values[8], maxY, 1e-6);
+
+	// Curve reordering permutes every plane alike, and the reordered system steps like the original
+	const SpaceFillingCurve curves[2] = { CURVE_MORTON, CURVE_HILBERT };
+	for (int c = 0; c < 2; ++c) {
+		std::srand(TEST_SEED);
+		Buffer orderbuff(type_of<float>(), NUM_PARTICLES, 7);
+		Buffer scratchbuff(type_of<float>(), NUM_PARTICLES, 7);
+		Image<float> unordered(orderbuff);
+		InitializeParticles(unordered, 0);
+		std::vector<float> original(7 * NUM_PARTICLES);
+		for (int k = 0; k < 7; ++k) {
+			for (int i = 0; i < NUM_PARTICLES; ++i) {
+				original[k * NUM_PARTICLES + i] = unordered(i, k);
+			}
+		}
+
+		ParticleOrder particleOrder(NUM_PARTICLES, 7, curves[c]);
+		double before = particleOrder.locality(orderbuff);
+		test.expect("first update reorders", particleOrder.update(orderbuff, scratchbuff));
+		double after = particleOrder.locality(orderbuff);
+		std::printf("Gravity: locality %.2f before reordering, %.2f after\n", before, after);
+		test.expect("reordering improves locality", after < 0.25 * before);
+		test.expect("an ordered system is not reordered again", !particleOrder.update(orderbuff, scratchbuff));
+
+		// Image caches its host pointer, so view the swapped buffer through a fresh one
+		Image<float> ordered(orderbuff);
+		const std::vector<int32_t>& identity = particleOrder.identity();
+		const uint32_t* keys = particleOrder.keys().data();
+		std::vector<bool> seen(NUM_PARTICLES, false);
+		bool permuted = true;
+		bool sorted = true;
+		std::vector<float> permutedState(7 * NUM_PARTICLES);
+		for (int i = 0; i < NUM_PARTICLES; ++i) {
+			int id = identity[i];
+			permuted = permuted && id >= 0 && id < NUM_PARTICLES && !seen[id];
+			if (!permuted) {
+				break;
+			}
+			seen[id] = true;
+			sorted = sorted && (i == 0 || keys[identity[i - 1]] <= keys[id]);
+			for (int k = 0; k < 7; ++k) {
+				permuted = permuted && ordered(i, k) == original[k * NUM_PARTICLES + id];
+				permutedState[k * NUM_PARTICLES + i] = original[k * NUM_PARTICLES + id];
+			}
+		}
+		test.expect("identity follows every plane", permuted);
+		test.expect("particles in key order", sorted);
+
+		Image<float> stepped(NUM_PARTICLES, 7);
+		Gravity(ordered, GRAVITY).realize(stepped);
+		ReferenceStep(permutedState, GRAVITY);
+		test.expectNear("reordered step against reference", MaxError(stepped, 0, permutedState), 0.0, 1e-3);
+	}
+
+	test.checkGolden(Checksum(result), totalMs / STEPS, 1e-4);
+	return test.result();
+}
@@ -0,0 +1,163 @@
+#ifndef HalideExamples_TestHarness_h
+#define HalideExamples_TestHarness_h
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <Halide.h>
+#include <Interior.h>
+
+// Shared helpers for the kernel regression tests.
+//
+// Each test runs a kernel headlessly for a fixed number of steps from a fixed seed and checks the
+// final state against a scalar C++ reference. It then compares a checksum of the state and the
+// measured time per step against the golden record Golden/<name>.golden, if there is one:
+//
+//   checksum <value>
+//   ms_per_step <value>
+//
+// Set HALIDE_EXAMPLES_UPDATE_GOLDEN=1 to (re)write the golden records on a reference machine.
+// A test without a record fails, so the checksum and performance gates can't silently stop
+// running.
+//
+// HALIDE_EXAMPLES_PERF_TOLERANCE (default 0.5) is the allowed fractional slowdown per step. Only
+// kernels whose baseline step takes at least HALIDE_EXAMPLES_PERF_MIN_MS (default 0.5 ms) are
+// timed against it; shorter steps are dominated by timer and scheduling noise.
+
+namespace HalideExamples {
+
+const unsigned int TEST_SEED = 12345;
+
+class TestCase {
+public:
+	explicit TestCase(const std::string& name)
+		: name(name)
+		, failures(0)
+	{
+		std::srand(TEST_SEED);
+	}
+
+	// Check that two values agree to within a tolerance relative to the larger of them
+	bool expectNear(const char* what, double actual, double expected, double tolerance) {
+		double scale = std::max(1.0, std::max(std::fabs(actual), std::fabs(expected)));
+		if (!(std::fabs(actual - expected) <= tolerance * scale)) {
+			std::printf("%s: %s is %.9g, expected %.9g\n", name.c_str(), what, actual, expected);
+			++failures;
+			return false;
+		}
+		return true;
+	}
+
+	void expect(const char* what, bool condition) {
+		if (!condition) {
+			std::printf("%s: %s\n", name.c_str(), what);
+			++failures;
+		}
+	}
+
+	// Compare the final checksum and time per step with the golden record
+	void checkGolden(double checksum, double msPerStep, double checksumTolerance) {
+		std::string path = std::string(GOLDEN_DIR) + "/" + name + ".golden";
+		std::printf("%s: checksum %.9g, %.4f ms/step\n", name.c_str(), checksum, msPerStep);
+
+		const char* update = std::getenv("HALIDE_EXAMPLES_UPDATE_GOLDEN");
+		if (update && std::atoi(update)) {
+			std::ofstream out(path.c_str());
+			out.precision(17);
+			out << "checksum " << checksum << "\n";
+			out << "ms_per_step " << msPerStep << "\n";
+			if (!out) {
+				std::printf("%s: could not write %s\n", name.c_str(), path.c_str());
+				++failures;
+				return;
+			}
+			std::printf("%s: wrote %s\n", name.c_str(), path.c_str());
+			return;
+		}
+
+		std::ifstream in(path.c_str());
+		std::string key;
+		double goldenChecksum = 0.0;
+		double goldenMsPerStep = 0.0;
+		if (!(in >> key >> goldenChecksum >> key >> goldenMsPerStep)) {
+			std::printf("%s: no golden record at %s; generate it with HALIDE_EXAMPLES_UPDATE_GOLDEN=1\n",
+						name.c_str(), path.c_str());
+			++failures;
+			return;
+		}
+
+		expectNear("checksum", checksum, goldenChecksum, checksumTolerance);
+
+		double tolerance = 0.5;
+		const char* perfTolerance = std::getenv("HALIDE_EXAMPLES_PERF_TOLERANCE");
+		if (perfTolerance) {
+			tolerance = std::atof(perfTolerance);
+		}
+		double minMs = 0.5;
+		const char* perfMinMs = std::getenv("HALIDE_EXAMPLES_PERF_MIN_MS");
+		if (perfMinMs) {
+			minMs = std::atof(perfMinMs);
+		}
+		if (goldenMsPerStep < minMs) {
+			std::printf("%s: baseline %.4f ms/step is too short to time, performance not gated\n", name.c_str(), goldenMsPerStep);
+		} else if (msPerStep > goldenMsPerStep * (1.0 + tolerance)) {
+			std::printf("%s: %.4f ms/step regressed past baseline %.4f ms/step\n", name.c_str(), msPerStep, goldenMsPerStep);
+			++failures;
+		}
+	}
+
+	int result() const {
+		if (failures) {
+			std::printf("%s: FAILED\n", name.c_str());
+			return 1;
+		}
+		std::printf("%s: passed\n", name.c_str());
+		return 0;
+	}
+
+	std::string name;
+	int failures;
+};
+
+// Wall-clock timer in milliseconds
+class Timer {
+public:
+	Timer() : start(std::chrono::steady_clock::now()) {}
+
+	double elapsedMs() const {
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+// Position-weighted sum of every element, so both value and ordering changes show up
+inline double Checksum(Halide::Image<float>& image) {
+	// Unused dimensions have zero extent
+	int height = std::max(1, image.extent(1));
+	int depth = std::max(1, image.extent(2));
+	int depth2 = std::max(1, image.extent(3));
+	double sum = 0.0;
+	int n = 0;
+	for (int w = 0; w < depth2; ++w) {
+		for (int z = 0; z < depth; ++z) {
+			for (int y = 0; y < height; ++y) {
+				for (int x = 0; x < image.width(); ++x) {
+					sum += image(x, y, z, w) * (1.0 + (n++ % 17) * 0.0625);
+				}
+			}
+		}
+	}
+	return sum;
+}
+
+}
+
+#endif // HalideExamples_TestHarness_h
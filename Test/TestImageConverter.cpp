@@ -1,9 +1,15 @@
 #include <ImageConverter.h>
 
+#include "TestHarness.h"
+
 using namespace HalideExamples;
 using namespace Halide;
 
+const int STEPS = 100;
+
 int main() {
+	TestCase test("ImageConverter");
+
 	Image<float> input(16, 16);
 	Image<uint32_t> output(16, 16);
 	ImageParam iparam(type_of<float>(), 2);
@@ -17,11 +23,30 @@ int main() {
 
 	iparam.set(input);
 	ic.realize(output);
+
+	double totalMs = 0.0;
+	for (int step = 0; step < STEPS; ++step) {
+		Timer timer;
+		ic.realize(output);
+		totalMs += timer.elapsedMs();
+	}
+
+	// The input ramps linearly from min to max, so the grey level should too, replicated into
+	// each of the three colour channels
+	Image<float> grey(16, 16);
 	for (int y = 0; y < 16; ++y) {
 		for (int x = 0; x < 16; ++x) {
-			printf("%X,", output(x, y));
+			uint32_t pixel = output(x, y);
+			uint32_t level = pixel & 0xFF;
+			test.expect("pixel is not grey", pixel == level * 0x010101);
+			int expected = y * 16 + x;
+			test.expect("grey level differs from linear ramp", std::abs(static_cast<int>(level) - expected) <= 1);
+			grey(x, y) = static_cast<float>(level);
 		}
-		printf("\n");
 	}
-	return 0;
+	test.expect("minimum does not map to black", output(0, 0) == 0);
+	test.expect("maximum does not map to white", output(15, 15) == 0xFFFFFF);
+
+	test.checkGolden(Checksum(grey), totalMs / STEPS, 0.0);
+	return test.result();
 }
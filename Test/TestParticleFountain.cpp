@@ -0,0 +1,233 @@
+#include <vector>
+
+#include <ParticleFountain.h>
+#include <StreamCompaction.h>
+#include <SpatialGrid.h>
+#include <Random.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+using namespace Halide;
+
+const int NUM_PARTICLES = 100000;
+const int STEPS = 100;
+const float GRAVITY = 0.001f;
+
+// Run one step into fresh output planes
+std::vector<Buffer> Step(Func& par) {
+	std::vector<Buffer> planes;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		planes.push_back(Buffer(type_of<float>(), NUM_PARTICLES));
+	}
+	planes.push_back(Buffer(type_of<uint8_t>(), NUM_PARTICLES));
+	par.realize(Realization(planes));
+	return planes;
+}
+
+int main() {
+	TestCase test("ParticleFountain");
+
+	Image<float> particles(NUM_PARTICLES, PARTICLE_PLANES);
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		particles(i, 0) = 640.0f;
+		particles(i, 1) = 719.0f;
+		particles(i, 2) = Random(-0.1f, 0.1f);
+		particles(i, 3) = Random(-0.3f, -0.03f);
+		particles(i, 4) = 1000.0f;
+	}
+
+	// The kernel has a closed form: x moves linearly and y follows a parabola
+	std::vector<float> x0(NUM_PARTICLES), y0(NUM_PARTICLES), vx(NUM_PARTICLES), vy0(NUM_PARTICLES);
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		x0[i] = particles(i, 0);
+		y0[i] = particles(i, 1);
+		vx[i] = particles(i, 2);
+		vy0[i] = particles(i, 3);
+	}
+
+	// Bounds far away, so every particle outlives the test
+	Param<float> gravity;
+	gravity.set(GRAVITY);
+	Func par = ParticleFountain(particles, gravity, 1e6f, 1e6f);
+	par.compile_jit();
+
+	double totalMs = 0.0;
+	int alive = 0;
+	for (int step = 0; step < STEPS; ++step) {
+		Timer timer;
+		std::vector<Buffer> planes = Step(par);
+		totalMs += timer.elapsedMs();
+
+		Image<uint8_t> mask(planes[PARTICLE_PLANES]);
+		alive = 0;
+		for (int p = 0; p < PARTICLE_PLANES; ++p) {
+			Image<float> plane(planes[p]);
+			for (int i = 0; i < NUM_PARTICLES; ++i) {
+				particles(i, p) = plane(i);
+			}
+		}
+		for (int i = 0; i < NUM_PARTICLES; ++i) {
+			alive += mask(i);
+		}
+	}
+	test.expect("particles died before their time", alive == NUM_PARTICLES);
+
+	double maxError = 0.0;
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		double n = STEPS;
+		double expectedX = x0[i] + n * vx[i];
+		double expectedY = y0[i] + n * vy0[i] + GRAVITY * n * (n + 1) / 2;
+		maxError = std::max(maxError, std::fabs(particles(i, 0) - expectedX));
+		maxError = std::max(maxError, std::fabs(particles(i, 1) - expectedY));
+	}
+	test.expectNear("max error against closed form", maxError, 0.0, 1e-2);
+	test.expectNear("life after the run", particles(0, 4), 1000.0f - STEPS, 0.0);
+
+	// Lifetimes and screen bounds retire particles, and compaction keeps the survivors in order
+	Image<float> mortal(NUM_PARTICLES, PARTICLE_PLANES);
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		mortal(i, 0) = static_cast<float>(i % 1280);
+		mortal(i, 1) = 100.0f;
+		mortal(i, 2) = (i % 3 == 0) ? 1.0f : 0.0f;
+		mortal(i, 3) = 0.0f;
+		mortal(i, 4) = static_cast<float>(1 + i % 5);
+	}
+	Func mortalPar = ParticleFountain(mortal, gravity, 1280, 720);
+	std::vector<Buffer> planes = Step(mortalPar);
+
+	std::vector<Image<float> > stepped;
+	std::vector<const float*> src;
+	std::vector<std::vector<float> > compacted(PARTICLE_PLANES, std::vector<float>(NUM_PARTICLES));
+	std::vector<float*> dst;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		stepped.push_back(Image<float>(planes[p]));
+		src.push_back(stepped[p].data());
+		dst.push_back(&compacted[p][0]);
+	}
+	Image<uint8_t> mask(planes[PARTICLE_PLANES]);
+	int live = CompactPlanes(src, dst, mask.data(), NUM_PARTICLES);
+
+	int expectedLive = 0;
+	for (int i = 0; i < NUM_PARTICLES; ++i) {
+		bool expectAlive = (1 + i % 5) > 1 && !(i % 1280 == 1279 && i % 3 == 0);
+		test.expect("alive mask disagrees with lifetime and bounds", (mask(i) != 0) == expectAlive);
+		if (expectAlive) {
+			for (int p = 0; p < PARTICLE_PLANES; ++p) {
+				if (live > expectedLive && compacted[p][expectedLive] != stepped[p](i)) {
+					test.expect("compaction moved the wrong particle", false);
+				}
+			}
+			++expectedLive;
+		}
+	}
+	test.expect("compaction kept the wrong number of particles", live == expectedLive);
+
+	// New particles start at the origin, move upward and have a whole-step lifetime in range
+	Param<int> seed;
+	seed.set(7);
+	Func emitter = ParticleEmitter(seed, 640, 719, 0.001f, 50.0f, 150.0f);
+	std::vector<Buffer> emittedPlanes;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		emittedPlanes.push_back(Buffer(type_of<float>(), 1024));
+	}
+	emitter.realize(Realization(emittedPlanes));
+	Image<float> ex(emittedPlanes[0]), ey(emittedPlanes[1]), evx(emittedPlanes[2]), evy(emittedPlanes[3]), elife(emittedPlanes[4]);
+	bool inRange = true;
+	for (int i = 0; i < 1024; ++i) {
+		float speed = std::sqrt(evx(i) * evx(i) + evy(i) * evy(i));
+		inRange = inRange && ex(i) == 640.0f && ey(i) == 719.0f;
+		inRange = inRange && evy(i) < 0.0f && speed >= 0.03f - 1e-5f && speed <= 0.3f + 1e-5f;
+		inRange = inRange && elife(i) >= 50.0f && elife(i) < 150.0f && elife(i) == std::floor(elife(i));
+	}
+	test.expect("emitted particles out of range", inRange);
+
+	// Grid collisions match a brute-force all-pairs pass when no cell is overcrowded
+	const int CROWD = 2048;
+	const float DISTANCE = 2.0f;
+	const float STIFFNESS = 0.01f;
+	const int GRID = 100;
+	Image<float> crowd(CROWD, PARTICLE_PLANES);
+	for (int i = 0; i < CROWD; ++i) {
+		crowd(i, 0) = Random(0.0f, GRID * DISTANCE);
+		crowd(i, 1) = Random(0.0f, GRID * DISTANCE);
+		crowd(i, 2) = 0.0f;
+		crowd(i, 3) = 0.0f;
+		crowd(i, 4) = 10.0f;
+	}
+	Image<int32_t> crowdKeys = ParticleCellKeys(crowd, DISTANCE, GRID, GRID).realize(CROWD);
+
+	SpatialGrid grid(GRID, GRID);
+	Image<float> sorted(CROWD, PARTICLE_PLANES);
+	std::vector<const float*> unsortedPlanes;
+	std::vector<float*> sortedPlanes;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		unsortedPlanes.push_back(crowd.data() + p * CROWD);
+		sortedPlanes.push_back(sorted.data() + p * CROWD);
+	}
+	grid.sort(crowdKeys.data(), unsortedPlanes, sortedPlanes, CROWD);
+
+	bool cellOrdered = true;
+	for (int c = 0; c < grid.cells(); ++c) {
+		for (int j = grid.cellStarts()(c); j < grid.cellStarts()(c + 1); ++j) {
+			int cx = static_cast<int>(std::floor(sorted(j, 0) / DISTANCE));
+			int cy = static_cast<int>(std::floor(sorted(j, 1) / DISTANCE));
+			cellOrdered = cellOrdered && std::min(cx, GRID - 1) + GRID * std::min(cy, GRID - 1) == c;
+		}
+	}
+	test.expect("grid sort did not group particles by cell", cellOrdered && grid.cellStarts()(grid.cells()) == CROWD);
+
+	std::vector<Buffer> collided;
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		collided.push_back(Buffer(type_of<float>(), CROWD));
+	}
+	ParticleCollisions(sorted, grid.cellStarts(), DISTANCE, GRID, GRID, DISTANCE, STIFFNESS).realize(Realization(collided));
+	Image<float> cvx(collided[2]), cvy(collided[3]);
+	double collisionError = 0.0;
+	for (int i = 0; i < CROWD; ++i) {
+		double ix = 0.0, iy = 0.0;
+		for (int j = 0; j < CROWD; ++j) {
+			double dx = sorted(i, 0) - sorted(j, 0);
+			double dy = sorted(i, 1) - sorted(j, 1);
+			double d = std::sqrt(dx * dx + dy * dy);
+			if (j != i && d < DISTANCE) {
+				double push = STIFFNESS * (DISTANCE - d) / std::max(d, 1e-3);
+				ix += push * dx;
+				iy += push * dy;
+			}
+		}
+		collisionError = std::max(collisionError, std::fabs(cvx(i) - ix) + std::fabs(cvy(i) - iy));
+	}
+	test.expectNear("grid collisions against all pairs", collisionError, 0.0, 1e-4);
+
+	// A cell holding more than MAX_PARTICLES_PER_CELL particles, like the fountain's source, still
+	// conserves momentum: the pushes within and around it come in equal and opposite pairs
+	const int PACKED = 40;
+	Image<float> packed(CROWD, PARTICLE_PLANES);
+	for (int i = 0; i < CROWD; ++i) {
+		bool inCell = i < PACKED;
+		packed(i, 0) = inCell ? Random(100.05f, 101.95f) : Random(96.0f, 106.0f);
+		packed(i, 1) = inCell ? Random(100.05f, 101.95f) : Random(96.0f, 106.0f);
+		packed(i, 2) = 0.0f;
+		packed(i, 3) = 0.0f;
+		packed(i, 4) = 10.0f;
+	}
+	Image<int32_t> packedKeys = ParticleCellKeys(packed, DISTANCE, GRID, GRID).realize(CROWD);
+	for (int p = 0; p < PARTICLE_PLANES; ++p) {
+		unsortedPlanes[p] = packed.data() + p * CROWD;
+	}
+	grid.sort(packedKeys.data(), unsortedPlanes, sortedPlanes, CROWD);
+	ParticleCollisions(sorted, grid.cellStarts(), DISTANCE, GRID, GRID, DISTANCE, STIFFNESS).realize(Realization(collided));
+	Image<float> pvx(collided[2]), pvy(collided[3]);
+	double momentumX = 0.0, momentumY = 0.0;
+	for (int i = 0; i < CROWD; ++i) {
+		momentumX += pvx(i);
+		momentumY += pvy(i);
+	}
+	test.expect("packed cell is over the per-cell cap", grid.cellStarts()(50 + GRID * 50 + 1) - grid.cellStarts()(50 + GRID * 50) > MAX_PARTICLES_PER_CELL);
+	test.expectNear("collision momentum x in a packed cell", momentumX, 0.0, 1e-5);
+	test.expectNear("collision momentum y in a packed cell", momentumY, 0.0, 1e-5);
+
+	test.checkGolden(Checksum(particles), totalMs / STEPS, 1e-4);
+	return test.result();
+}
@@ -0,0 +1,140 @@
+#include <Graphics.h>
+#include <WavePropagator.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+using namespace Halide;
+
+const int WIDTH = 256;
+const int HEIGHT = 256;
+const int STEPS = 50;
+
+struct V3 {
+	double x, y, z;
+};
+
+V3 Normalized(V3 v) {
+	double mag = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	V3 n = { v.x / mag, v.y / mag, v.z / mag };
+	return n;
+}
+
+double Dot(V3 a, V3 b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Scalar version of the diffuse and specular terms shared by both shaders
+void ReferenceShade(Image<float>& input, int x, int y, V3 light, V3 eye, double& diffuse, double& specular) {
+	// cross((1, 0, dzdx), (0, 1, dzdy)) = (-dzdx, -dzdy, 1)
+	double dzdx = (input(x + 1, y) - input(x - 1, y)) / 2.0;
+	double dzdy = (input(x, y + 1) - input(x, y - 1)) / 2.0;
+	V3 normal = Normalized(V3{ -dzdx, -dzdy, 1.0 });
+	V3 l = Normalized(V3{ light.x - x, light.y - y, light.z - input(x, y) });
+	diffuse = Dot(l, normal);
+
+	V3 e = Normalized(V3{ x - eye.x, y - eye.y, input(x, y) - eye.z });
+	double k = 2 * Dot(e, normal);
+	V3 reflect = { e.x - k * normal.x, e.y - k * normal.y, e.z - k * normal.z };
+	specular = Dot(l, reflect) > 0.98 ? 0.5 : 0.0;
+}
+
+int main() {
+	TestCase test("Shaders");
+
+	// A smooth bump with some random ripples on top
+	Image<float> input(WIDTH, HEIGHT);
+	for (int y = 0; y < HEIGHT; ++y) {
+		for (int x = 0; x < WIDTH; ++x) {
+			float dx = (x - WIDTH / 2) / 40.0f;
+			float dy = (y - HEIGHT / 2) / 40.0f;
+			input(x, y) = 30.0f * std::exp(-(dx * dx + dy * dy)) + 0.01f * (std::rand() % 100);
+		}
+	}
+
+	V3 light = { -15000.0, -5000.0, 20000.0 };
+	V3 eye = { 128.0, 128.0, 1000.0 };
+	Param<float> lx, ly, lz, ex, ey, ez;
+	lx.set(light.x);
+	ly.set(light.y);
+	lz.set(light.z);
+	ex.set(eye.x);
+	ey.set(eye.y);
+	ez.set(eye.z);
+
+	Func diffuseShader = InitializeDiffuseShader(input, lx, ly, lz);
+	Func specularShader = InitializeSpecularShader(input, lx, ly, lz, ex, ey, ez);
+
+	Buffer diffusebuff(type_of<float>(), WIDTH, HEIGHT);
+	Buffer specularbuff(type_of<float>(), WIDTH, HEIGHT);
+	RealizeInterior(diffuseShader, diffusebuff, 1);
+	RealizeInterior(specularShader, specularbuff, 1);
+
+	double totalMs = 0.0;
+	for (int step = 0; step < STEPS; ++step) {
+		Timer timer;
+		RealizeInterior(specularShader, specularbuff, 1);
+		totalMs += timer.elapsedMs();
+	}
+
+	Image<float> diffuse(diffusebuff);
+	Image<float> specular(specularbuff);
+	double diffuseError = 0.0;
+	int specularMismatches = 0;
+	for (int y = 1; y < HEIGHT - 1; ++y) {
+		for (int x = 1; x < WIDTH - 1; ++x) {
+			double d, s;
+			ReferenceShade(input, x, y, light, eye, d, s);
+			diffuseError = std::max(diffuseError, std::fabs(diffuse(x, y) - d));
+			// The highlight threshold can flip for pixels right at its edge
+			if (std::fabs(specular(x, y) - (d + s) / 1.5) > 1e-3) {
+				++specularMismatches;
+			}
+		}
+	}
+	test.expectNear("diffuse max error against reference", diffuseError, 0.0, 1e-4);
+	test.expect("specular differs from reference on more than 0.1% of pixels", specularMismatches <= WIDTH * HEIGHT / 1000);
+
+	// Fused wave step and shading matches the separate pipelines exactly
+	Image<float> prev(WIDTH, HEIGHT);
+	Image<float> scale(WIDTH, HEIGHT);
+	for (int y = 0; y < HEIGHT; ++y) {
+		for (int x = 0; x < WIDTH; ++x) {
+			prev(x, y) = 0.5f * input(x, y);
+			scale(x, y) = 0.3f;
+		}
+	}
+	Func wave = WavePropagator(prev, input, scale);
+	Func fused = WavePropagatorShaded(prev, input, scale, lx, ly, lz, ex, ey, ez);
+	Buffer wavebuff(type_of<float>(), WIDTH, HEIGHT);
+	Buffer fusedwavebuff(type_of<float>(), WIDTH, HEIGHT);
+	Buffer fusedshadebuff(type_of<float>(), WIDTH, HEIGHT);
+	RealizeInterior(wave, wavebuff, 1);
+	std::vector<Buffer> fusedOutputs;
+	fusedOutputs.push_back(fusedwavebuff);
+	fusedOutputs.push_back(fusedshadebuff);
+	RealizeInterior(fused, fusedOutputs, 1);
+	Image<float> waveResult(wavebuff);
+	Image<float> fusedWave(fusedwavebuff);
+	Image<float> fusedShade(fusedshadebuff);
+	double fusedWaveError = 0.0;
+	double fusedShadeError = 0.0;
+	for (int y = 1; y < HEIGHT - 1; ++y) {
+		for (int x = 1; x < WIDTH - 1; ++x) {
+			fusedWaveError = std::max(fusedWaveError, static_cast<double>(std::fabs(fusedWave(x, y) - waveResult(x, y))));
+			fusedShadeError = std::max(fusedShadeError, static_cast<double>(std::fabs(fusedShade(x, y) - specular(x, y))));
+		}
+	}
+	test.expectNear("fused wave max error against WavePropagator", fusedWaveError, 0.0, 1e-6);
+	test.expectNear("fused shade max error against the specular shader", fusedShadeError, 0.0, 1e-6);
+
+	// Checksum the interior only; the border is never written
+	Image<float> interior(WIDTH - 2, HEIGHT - 2);
+	for (int y = 1; y < HEIGHT - 1; ++y) {
+		for (int x = 1; x < WIDTH - 1; ++x) {
+			interior(x - 1, y - 1) = specular(x, y);
+		}
+	}
+	test.checkGolden(Checksum(interior), totalMs / STEPS, 1e-4);
+	return test.result();
+}
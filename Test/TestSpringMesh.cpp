@@ -0,0 +1,259 @@
+#include <vector>
+
+#include <SpringMesh.h>
+#include <ImplicitSpringMesh.h>
+#include <Random.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+using namespace Halide;
+
+const int MESH_WIDTH = 32;
+const int MESH_HEIGHT = 32;
+const int INSTANCES = 3;
+const int STEPS = 50;
+const float SPRING_REST_LENGTH = 5.0f;
+const float SPRING_FORCE = 0.3f;
+const float GRAVITY = 0.0001f;
+const int ENERGY_STEPS = 500;
+
+// A slightly jittered grid, so the springs start out under tension
+void InitializeMesh(Image<float>& mesh, int m) {
+	for (int y = 0; y < MESH_HEIGHT; ++y) {
+		for (int x = 0; x < MESH_WIDTH; ++x) {
+			mesh(x, y, 0, m) = 100.0f + 5.5f * x + Random(-0.5f, 0.5f);
+			mesh(x, y, 1, m) = 100.0f + 5.5f * y + Random(-0.5f, 0.5f);
+			mesh(x, y, 2, m) = 0.0f;
+			mesh(x, y, 3, m) = 0.0f;
+		}
+	}
+}
+
+// Scalar step matching SpringMesh. state holds 4 planes of MESH_WIDTH x MESH_HEIGHT values.
+void ReferenceStep(std::vector<float>& state, float springForce, float restLength, float gravity) {
+	const int plane = MESH_WIDTH * MESH_HEIGHT;
+	std::vector<float> next(state);
+	for (int y = 0; y < MESH_HEIGHT; ++y) {
+		for (int x = 0; x < MESH_WIDTH; ++x) {
+			int i = y * MESH_WIDTH + x;
+			float fx = 0.0f, fy = 0.0f;
+			for (int dy = -1; dy <= 1; ++dy) {
+				for (int dx = -1; dx <= 1; ++dx) {
+					int x1 = x + dx;
+					int y1 = y + dy;
+					if ((dx == 0 && dy == 0) || x1 < 0 || x1 >= MESH_WIDTH || y1 < 0 || y1 >= MESH_HEIGHT) {
+						continue;
+					}
+					int j = y1 * MESH_WIDTH + x1;
+					float rest = (dx != 0 && dy != 0) ? 1.4142135623f * restLength : restLength;
+					float drx = state[j] - state[i];
+					float dry = state[plane + j] - state[plane + i];
+					float len = std::sqrt(drx * drx + dry * dry);
+					float f = (len - rest) * springForce;
+					fx += f * drx / len;
+					fy += f * dry / len;
+				}
+			}
+			next[i] = state[i] + state[2 * plane + i] + fx;
+			next[plane + i] = state[plane + i] + state[3 * plane + i] + fy + gravity;
+			next[2 * plane + i] = state[2 * plane + i] + fx;
+			next[3 * plane + i] = state[3 * plane + i] + fy + gravity;
+		}
+	}
+	state.swap(next);
+}
+
+std::vector<float> ReferenceState(Image<float>& mesh, int m) {
+	std::vector<float> state(4 * MESH_WIDTH * MESH_HEIGHT);
+	for (int z = 0; z < 4; ++z) {
+		for (int y = 0; y < MESH_HEIGHT; ++y) {
+			for (int x = 0; x < MESH_WIDTH; ++x) {
+				state[(z * MESH_HEIGHT + y) * MESH_WIDTH + x] = mesh(x, y, z, m);
+			}
+		}
+	}
+	return state;
+}
+
+double MaxError(Image<float>& mesh, int m, const std::vector<float>& state) {
+	double error = 0.0;
+	for (int z = 0; z < 4; ++z) {
+		for (int y = 0; y < MESH_HEIGHT; ++y) {
+			for (int x = 0; x < MESH_WIDTH; ++x) {
+				double expected = state[(z * MESH_HEIGHT + y) * MESH_WIDTH + x];
+				error = std::max(error, std::fabs(mesh(x, y, z, m) - expected) / std::max(1.0, std::fabs(expected)));
+			}
+		}
+	}
+	return error;
+}
+
+// Kinetic plus spring potential energy of a single mesh, with unit masses and gravity left out
+double Energy(Image<float>& mesh, float springForce = SPRING_FORCE) {
+	double energy = 0.0;
+	const int offsets[4][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { -1, 1 } };
+	for (int y = 0; y < MESH_HEIGHT; ++y) {
+		for (int x = 0; x < MESH_WIDTH; ++x) {
+			energy += 0.5 * (mesh(x, y, 2) * mesh(x, y, 2) + mesh(x, y, 3) * mesh(x, y, 3));
+			for (int o = 0; o < 4; ++o) {
+				int x1 = x + offsets[o][0];
+				int y1 = y + offsets[o][1];
+				if (x1 < 0 || x1 >= MESH_WIDTH || y1 >= MESH_HEIGHT) {
+					continue;
+				}
+				double rest = (x1 != x) && (y1 != y) ? 1.4142135623 * SPRING_REST_LENGTH : SPRING_REST_LENGTH;
+				double dx = mesh(x1, y1, 0) - mesh(x, y, 0);
+				double dy = mesh(x1, y1, 1) - mesh(x, y, 1);
+				double stretch = std::sqrt(dx * dx + dy * dy) - rest;
+				energy += 0.5 * springForce * stretch * stretch;
+			}
+		}
+	}
+	return energy;
+}
+
+// Run a mesh for ENERGY_STEPS steps at the given precision and return its final energy
+double FinalEnergy(MathPrecision precision, double& initialEnergy) {
+	std::srand(TEST_SEED);
+	Buffer oldbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
+	Buffer newbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
+	Image<float> mesh(oldbuff);
+	InitializeMesh(mesh, 0);
+	initialEnergy = Energy(mesh);
+	Func spring = SpringMesh(mesh, SPRING_FORCE, SPRING_REST_LENGTH, 0.0f, precision);
+	for (int step = 0; step < ENERGY_STEPS; ++step) {
+		spring.realize(newbuff);
+		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
+	}
+	Image<float> result(oldbuff);
+	return Energy(result);
+}
+
+int main() {
+	TestCase test("SpringMesh");
+
+	// Single mesh against the scalar reference
+	Buffer oldbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
+	Buffer newbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
+	Image<float> oldmesh(oldbuff);
+	InitializeMesh(oldmesh, 0);
+	std::vector<float> state = ReferenceState(oldmesh, 0);
+
+	Func spring = SpringMesh(oldmesh, SPRING_FORCE, SPRING_REST_LENGTH, GRAVITY);
+	spring.compile_jit();
+	double totalMs = 0.0;
+	for (int step = 0; step < STEPS; ++step) {
+		Timer timer;
+		spring.realize(newbuff);
+		totalMs += timer.elapsedMs();
+		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
+		ReferenceStep(state, SPRING_FORCE, SPRING_REST_LENGTH, GRAVITY);
+	}
+	Image<float> result(oldbuff);
+	test.expectNear("max relative error against reference", MaxError(result, 0, state), 0.0, 1e-3);
+
+	// Ensemble: each instance has its own spring force and rest length
+	Buffer oldens(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4, INSTANCES);
+	Buffer newens(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4, INSTANCES);
+	Image<float> oldensemble(oldens);
+	Image<float> params(INSTANCES, 3);
+	std::vector<std::vector<float> > states;
+	for (int m = 0; m < INSTANCES; ++m) {
+		InitializeMesh(oldensemble, m);
+		params(m, 0) = SPRING_FORCE * (1.0f - 0.25f * m);
+		params(m, 1) = SPRING_REST_LENGTH + m;
+		params(m, 2) = GRAVITY;
+		states.push_back(ReferenceState(oldensemble, m));
+	}
+
+	Func ens = SpringMeshEnsemble(oldensemble, params);
+	for (int step = 0; step < STEPS; ++step) {
+		ens.realize(newens);
+		std::swap(*oldens.raw_buffer(), *newens.raw_buffer());
+	}
+	Image<float> ensResult(oldens);
+	for (int m = 0; m < INSTANCES; ++m) {
+		for (int step = 0; step < STEPS; ++step) {
+			ReferenceStep(states[m], params(m, 0), params(m, 1), params(m, 2));
+		}
+		test.expectNear("ensemble max relative error against reference", MaxError(ensResult, m, states[m]), 0.0, 1e-3);
+	}
+
+	// Telemetry partials, realized alongside the step, reduce to the scalar energy of the input state
+	Func telemetry;
+	Func telemetryStep = SpringMesh(result, SPRING_FORCE, SPRING_REST_LENGTH, GRAVITY, PRECISION_EXACT, &telemetry);
+	Pipeline telemetryPipeline(std::vector<Func>{ telemetryStep, telemetry });
+	Buffer partialsbuff(type_of<float>(), MESH_HEIGHT, SPRING_MESH_TELEMETRY_COUNT);
+	telemetryPipeline.realize(Realization(std::vector<Buffer>{ newbuff, partialsbuff }));
+	Image<float> partials(partialsbuff);
+	TelemetrySnapshot snapshot;
+	snapshot.count = 0;
+	ReducePartials(partials, SPRING_MESH_TELEMETRY, SPRING_MESH_TELEMETRY_COUNT, snapshot);
+	test.expectNear("telemetry kinetic plus potential energy", snapshot.values[0] + snapshot.values[1], Energy(result), 1e-4);
+
+	// Fast math: the energy of the fast path stays close to the exact path's
+	double initialEnergy = 0.0;
+	double exactEnergy = FinalEnergy(PRECISION_EXACT, initialEnergy);
+	double fastEnergy = FinalEnergy(PRECISION_FAST, initialEnergy);
+	test.expect("fast math energy drift against exact path within 0.1%",
+				std::fabs(fastEnergy - exactEnergy) <= 1e-3 * std::max(initialEnergy, exactEnergy));
+
+	// Implicit integrator: a mesh at rest stays put without any solver work
+	Image<float> implicitMesh(MESH_WIDTH, MESH_HEIGHT, 4);
+	for (int y = 0; y < MESH_HEIGHT; ++y) {
+		for (int x = 0; x < MESH_WIDTH; ++x) {
+			implicitMesh(x, y, 0) = 100.0f + SPRING_REST_LENGTH * x;
+			implicitMesh(x, y, 1) = 100.0f + SPRING_REST_LENGTH * y;
+			implicitMesh(x, y, 2) = 0.0f;
+			implicitMesh(x, y, 3) = 0.0f;
+		}
+	}
+	ImplicitSpringMesh resting(MESH_WIDTH, MESH_HEIGHT, SPRING_FORCE, SPRING_REST_LENGTH, 0.0f, 4.0f);
+	ImplicitSpringMesh::SolveStats restStats = resting.step(implicitMesh);
+	test.expect("mesh at rest needs no iterations", restStats.iterations == 0);
+	test.expectNear("mesh at rest doesn't move", implicitMesh(MESH_WIDTH / 2, MESH_HEIGHT / 2, 0),
+					100.0f + SPRING_REST_LENGTH * (MESH_WIDTH / 2), 1e-5);
+
+	// Springs far too stiff for the explicit step stay bounded with large implicit steps, and
+	// every solve converges
+	const float STIFF_SPRING_FORCE = 2.0f;
+	const float IMPLICIT_TIMESTEP = 4.0f;
+	Image<float> stiffMesh(MESH_WIDTH, MESH_HEIGHT, 4);
+	for (int y = 0; y < MESH_HEIGHT; ++y) {
+		for (int x = 0; x < MESH_WIDTH; ++x) {
+			stiffMesh(x, y, 0) = 100.0f + 5.5f * x + Random(-0.5f, 0.5f);
+			stiffMesh(x, y, 1) = 100.0f + 5.5f * y + Random(-0.5f, 0.5f);
+			stiffMesh(x, y, 2) = 0.0f;
+			stiffMesh(x, y, 3) = 0.0f;
+		}
+	}
+	ImplicitSpringMesh stiff(MESH_WIDTH, MESH_HEIGHT, STIFF_SPRING_FORCE, SPRING_REST_LENGTH, GRAVITY, IMPLICIT_TIMESTEP);
+	bool converged = true;
+	for (int step = 0; step < STEPS; ++step) {
+		ImplicitSpringMesh::SolveStats stats = stiff.step(stiffMesh);
+		converged = converged && stats.residual <= 1e-4f;
+	}
+	// Written so a NaN speed counts as unbounded
+	bool bounded = true;
+	for (int y = 0; y < MESH_HEIGHT; ++y) {
+		for (int x = 0; x < MESH_WIDTH; ++x) {
+			float speed = std::sqrt(stiffMesh(x, y, 2) * stiffMesh(x, y, 2) + stiffMesh(x, y, 3) * stiffMesh(x, y, 3));
+			bounded = bounded && speed < 5.0f;
+		}
+	}
+	test.expect("implicit solves converge", converged);
+
+	// The implicit step's telemetry describes the mesh it started from
+	double implicitEnergy = Energy(stiffMesh, STIFF_SPRING_FORCE);
+	stiff.step(stiffMesh, &partials);
+	TelemetrySnapshot implicitSnapshot;
+	implicitSnapshot.count = 0;
+	ReducePartials(partials, SPRING_MESH_TELEMETRY, SPRING_MESH_TELEMETRY_COUNT, implicitSnapshot);
+	test.expectNear("implicit telemetry kinetic plus potential energy",
+					implicitSnapshot.values[0] + implicitSnapshot.values[1], implicitEnergy, 1e-4);
+	test.expect("stiff mesh stays bounded", bounded);
+
+	test.checkGolden(Checksum(result), totalMs / STEPS, 1e-4);
+	return test.result();
+}
@@ -0,0 +1,94 @@
+#include <vector>
+
+#include <SpringMesh.h>
+#include <SpringNetwork.h>
+#include <Random.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+using namespace Halide;
+
+const int MESH_WIDTH = 32;
+const int MESH_HEIGHT = 32;
+const int NODES = MESH_WIDTH * MESH_HEIGHT;
+const int STEPS = 50;
+const float SPRING_REST_LENGTH = 5.0f;
+const float SPRING_FORCE = 0.3f;
+const float GRAVITY = 0.0001f;
+
+int main() {
+	TestCase test("SpringNetwork");
+
+	// The grid of SpringMesh as a network, with nodes numbered in random order
+	std::vector<int> gridIndex;
+	SpringNetwork network = GridSpringNetwork(MESH_WIDTH, MESH_HEIGHT, SPRING_REST_LENGTH, gridIndex);
+	int shuffledBandwidth = network.bandwidth();
+	network.reorder();
+	test.expect("reordering reduces bandwidth", network.bandwidth() < shuffledBandwidth / 4);
+	test.expect("max degree of the grid", network.maxDegree() == 8);
+
+	const std::vector<int>& permutation = network.permutation();
+
+	Buffer oldmeshbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
+	Buffer newmeshbuff(type_of<float>(), MESH_WIDTH, MESH_HEIGHT, 4);
+	Image<float> mesh(oldmeshbuff);
+	for (int y = 0; y < MESH_HEIGHT; ++y) {
+		for (int x = 0; x < MESH_WIDTH; ++x) {
+			mesh(x, y, 0) = 100.0f + 5.5f * x + Random(-0.5f, 0.5f);
+			mesh(x, y, 1) = 100.0f + 5.5f * y + Random(-0.5f, 0.5f);
+			mesh(x, y, 2) = 0.0f;
+			mesh(x, y, 3) = 0.0f;
+		}
+	}
+	Buffer oldbuff(type_of<float>(), NODES, 4);
+	Buffer newbuff(type_of<float>(), NODES, 4);
+	Image<float> nodes(oldbuff);
+	for (int i = 0; i < NODES; ++i) {
+		int g = gridIndex[permutation[i]];
+		for (int z = 0; z < 4; ++z) {
+			nodes(i, z) = mesh(g % MESH_WIDTH, g / MESH_WIDTH, z);
+		}
+	}
+
+	// Step both the grid kernel and the network kernel from the same state
+	Func grid = SpringMesh(mesh, SPRING_FORCE, SPRING_REST_LENGTH, GRAVITY);
+	Func step = SpringNetworkStep(nodes, network.offsets(), network.neighbours(), network.restLengths(),
+								  network.maxDegree(), SPRING_FORCE, GRAVITY);
+	step.compile_jit();
+	grid.compile_jit();
+	double totalMs = 0.0;
+	double gridMs = 0.0;
+	for (int s = 0; s < STEPS; ++s) {
+		Timer timer;
+		step.realize(newbuff);
+		totalMs += timer.elapsedMs();
+		std::swap(*oldbuff.raw_buffer(), *newbuff.raw_buffer());
+		Timer gridTimer;
+		grid.realize(newmeshbuff);
+		gridMs += gridTimer.elapsedMs();
+		std::swap(*oldmeshbuff.raw_buffer(), *newmeshbuff.raw_buffer());
+	}
+
+	// Compare with the grid kernel. Both read and write 4 state planes per node; the network also
+	// reads its CSR row: one offset, plus a neighbour index and a rest length per spring end.
+	double stateBytes = 2.0 * 4 * sizeof(float);
+	double csrBytes = sizeof(int32_t) + static_cast<double>(network.edges()) / NODES * (sizeof(int32_t) + sizeof(float));
+	std::printf("SpringNetwork: grid %.1f bytes/node, %.4f ms/step; network %.1f bytes/node, %.4f ms/step (%.2fx)\n",
+				stateBytes, gridMs / STEPS, stateBytes + csrBytes, totalMs / STEPS, totalMs / std::max(gridMs, 1e-9));
+
+	Image<float> result(oldbuff);
+	Image<float> expected(oldmeshbuff);
+	double error = 0.0;
+	for (int i = 0; i < NODES; ++i) {
+		int g = gridIndex[permutation[i]];
+		for (int z = 0; z < 4; ++z) {
+			double e = expected(g % MESH_WIDTH, g / MESH_WIDTH, z);
+			error = std::max(error, std::fabs(result(i, z) - e) / std::max(1.0, std::fabs(e)));
+		}
+	}
+	test.expectNear("max relative error against the grid kernel", error, 0.0, 1e-3);
+
+	test.checkGolden(Checksum(result), totalMs / STEPS, 1e-4);
+	return test.result();
+}
@@ -0,0 +1,81 @@
+#include <atomic>
+#include <thread>
+
+#include <Telemetry.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+using namespace Halide;
+
+const int PUBLISHES = 200000;
+
+int main() {
+	TestCase test("Telemetry");
+
+	// Partials reduce per quantity
+	Image<float> partials(4, 3);
+	for (int t = 0; t < 4; ++t) {
+		partials(t, 0) = t + 1.0f;
+		partials(t, 1) = 10.0f - t;
+		partials(t, 2) = t * 2.0f;
+	}
+	const TelemetryQuantity quantities[3] = {
+		{ "sum", REDUCE_SUM },
+		{ "min", REDUCE_MIN },
+		{ "max", REDUCE_MAX },
+	};
+	TelemetrySnapshot reduced;
+	reduced.count = 0;
+	ReducePartials(partials, quantities, 3, reduced);
+	test.expect("three quantities reduced", reduced.count == 3);
+	test.expectNear("sum of partials", reduced.values[0], 10.0, 0.0);
+	test.expectNear("min of partials", reduced.values[1], 7.0, 0.0);
+	test.expectNear("max of partials", reduced.values[2], 6.0, 0.0);
+
+	// A reader racing a writer only ever sees whole snapshots
+	TelemetryPublisher publisher("HalideExamples.TestTelemetry");
+	TelemetryReader reader("HalideExamples.TestTelemetry");
+	test.expect("segment created", publisher.valid());
+	test.expect("segment opened", reader.valid());
+	TelemetrySnapshot snapshot;
+	test.expect("nothing to read before the first publish", !reader.read(snapshot));
+
+	std::atomic<bool> done(false);
+	std::thread writer([&]() {
+		TelemetrySnapshot written;
+		written.count = TELEMETRY_MAX_VALUES;
+		for (int frame = 1; frame <= PUBLISHES; ++frame) {
+			written.frame = frame;
+			for (int v = 0; v < TELEMETRY_MAX_VALUES; ++v) {
+				written.values[v] = frame;
+			}
+			publisher.publish(written);
+		}
+		done = true;
+	});
+	int reads = 0;
+	int torn = 0;
+	uint64_t lastFrame = 0;
+	bool ordered = true;
+	while (!done) {
+		if (reader.read(snapshot)) {
+			++reads;
+			for (int v = 0; v < snapshot.count; ++v) {
+				if (snapshot.values[v] != static_cast<double>(snapshot.frame)) {
+					++torn;
+					break;
+				}
+			}
+			ordered = ordered && snapshot.frame >= lastFrame;
+			lastFrame = snapshot.frame;
+		}
+	}
+	writer.join();
+	std::printf("Telemetry: %d reads during %d publishes\n", reads, PUBLISHES);
+	test.expect("no torn snapshots", torn == 0);
+	test.expect("snapshots in order", ordered);
+	test.expect("last snapshot visible", reader.read(snapshot) && snapshot.frame == static_cast<uint64_t>(PUBLISHES));
+
+	return test.result();
+}
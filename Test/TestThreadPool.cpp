@@ -0,0 +1,53 @@
+#include <ThreadPool.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+
+int main() {
+	TestCase test("ThreadPool");
+
+	ThreadPool::Options options;
+	options.threads = 4;
+	ThreadPool pool(options);
+
+	// Nested parallel loops must complete every iteration exactly once
+	std::atomic<long> sum(0);
+	for (int rep = 0; rep < 20; ++rep) {
+		pool.parallelFor(0, 1000, [&](int i) {
+			pool.parallelFor(0, 10, [&](int j) {
+				sum += j;
+				return 0;
+			});
+			sum += i;
+			return 0;
+		});
+	}
+	test.expect("nested parallelFor missed or repeated iterations", sum == 20L * (499500 + 1000 * 45));
+
+	// The first error is reported back to the caller
+	int result = pool.parallelFor(0, 100, [](int i) {
+		return i == 50 ? 7 : 0;
+	});
+	test.expect("parallelFor did not report the task error", result == 7);
+
+	// Asynchronous tasks share the same workers
+	std::atomic<int> done(0);
+	for (int i = 0; i < 100; ++i) {
+		pool.submit([&] {
+			++done;
+		});
+	}
+	while (done < 100) {
+		std::this_thread::yield();
+	}
+
+	uint64_t tasks = 0;
+	std::vector<ThreadPool::WorkerStats> stats = pool.stats();
+	for (size_t i = 0; i < stats.size(); ++i) {
+		tasks += stats[i].tasks;
+	}
+	test.expect("worker counters missed submitted tasks", tasks >= 100);
+
+	return test.result();
+}
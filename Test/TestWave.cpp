@@ -0,0 +1,207 @@
+#include <vector>
+
+#include <WavePropagator.h>
+
+#include "TestHarness.h"
+
+using namespace HalideExamples;
+using namespace Halide;
+
+const int WIDTH = 256;
+const int HEIGHT = 256;
+const int INSTANCES = 3;
+const int STEPS = 200;
+
+// Scalar FTCS step over the interior, matching WavePropagator
+void ReferenceStep(const std::vector<float>& prev, const std::vector<float>& curr, std::vector<float>& next, float scale) {
+	for (int y = 1; y < HEIGHT - 1; ++y) {
+		for (int x = 1; x < WIDTH - 1; ++x) {
+			int i = y * WIDTH + x;
+			float laplacian = curr[i - WIDTH] + curr[i - 1] + curr[i + 1] + curr[i + WIDTH] - 4 * curr[i];
+			next[i] = scale * laplacian + 2 * curr[i] - prev[i];
+		}
+	}
+}
+
+int main() {
+	TestCase test("Wave");
+
+	Buffer buff1(type_of<float>(), WIDTH, HEIGHT);
+	Buffer buff2(type_of<float>(), WIDTH, HEIGHT);
+	Buffer buff3(type_of<float>(), WIDTH, HEIGHT);
+	Image<float> prev(buff1);
+	Image<float> curr(buff2);
+	Image<float> next(buff3);
+	Image<float> scale(WIDTH, HEIGHT);
+
+	std::vector<float> refPrev(WIDTH * HEIGHT, 0.0f);
+	std::vector<float> refCurr(WIDTH * HEIGHT, 0.0f);
+	std::vector<float> refNext(WIDTH * HEIGHT, 0.0f);
+
+	for (int y = 0; y < HEIGHT; ++y) {
+		for (int x = 0; x < WIDTH; ++x) {
+			prev(x, y) = 0.0f;
+			curr(x, y) = 0.0f;
+			next(x, y) = 0.0f;
+			scale(x, y) = 0.3f;
+		}
+	}
+	for (int i = 0; i < 50; ++i) {
+		int x = 1 + std::rand() % (WIDTH - 2);
+		int y = 1 + std::rand() % (HEIGHT - 2);
+		curr(x, y) = 1.0f;
+		refCurr[y * WIDTH + x] = 1.0f;
+	}
+
+	// Single field against the scalar reference
+	Func wv = WavePropagator(Image<float>(buff1), Image<float>(buff2), scale);
+	RealizeInterior(wv, buff3, 1);	// JIT compile outside the timed loop
+	double totalMs = 0.0;
+	for (int step = 0; step < STEPS; ++step) {
+		Timer timer;
+		RealizeInterior(wv, buff3, 1);
+		totalMs += timer.elapsedMs();
+		std::swap(*buff1.raw_buffer(), *buff2.raw_buffer());
+		std::swap(*buff2.raw_buffer(), *buff3.raw_buffer());
+
+		ReferenceStep(refPrev, refCurr, refNext, 0.3f);
+		refPrev.swap(refCurr);
+		refCurr.swap(refNext);
+	}
+	double msPerStep = totalMs / STEPS;
+
+	Image<float> result(buff2);
+	double maxError = 0.0;
+	for (int y = 0; y < HEIGHT; ++y) {
+		for (int x = 0; x < WIDTH; ++x) {
+			maxError = std::max(maxError, static_cast<double>(std::fabs(result(x, y) - refCurr[y * WIDTH + x])));
+		}
+	}
+	test.expectNear("max error against reference", maxError, 0.0, 1e-4);
+
+	// In place: next overwrites prev, and the two buffers swap roles each step
+	Buffer inPlaceBuff1(type_of<float>(), WIDTH, HEIGHT);
+	Buffer inPlaceBuff2(type_of<float>(), WIDTH, HEIGHT);
+	Image<float> inPlacePrev(inPlaceBuff1);
+	Image<float> inPlaceCurr(inPlaceBuff2);
+	std::vector<float> inPlaceRefPrev(WIDTH * HEIGHT, 0.0f);
+	std::vector<float> inPlaceRefCurr(WIDTH * HEIGHT, 0.0f);
+	std::vector<float> inPlaceRefNext(WIDTH * HEIGHT, 0.0f);
+	for (int y = 0; y < HEIGHT; ++y) {
+		for (int x = 0; x < WIDTH; ++x) {
+			inPlacePrev(x, y) = 0.0f;
+			inPlaceCurr(x, y) = 0.0f;
+		}
+	}
+	for (int i = 0; i < 50; ++i) {
+		int x = 1 + std::rand() % (WIDTH - 2);
+		int y = 1 + std::rand() % (HEIGHT - 2);
+		inPlaceCurr(x, y) = 1.0f;
+		inPlaceRefCurr[y * WIDTH + x] = 1.0f;
+	}
+	Func inPlace = WavePropagator(Image<float>(inPlaceBuff1), Image<float>(inPlaceBuff2), scale);
+	for (int step = 0; step < STEPS; ++step) {
+		RealizeInterior(inPlace, inPlaceBuff1, 1);
+		std::swap(*inPlaceBuff1.raw_buffer(), *inPlaceBuff2.raw_buffer());
+
+		ReferenceStep(inPlaceRefPrev, inPlaceRefCurr, inPlaceRefNext, 0.3f);
+		inPlaceRefPrev.swap(inPlaceRefCurr);
+		inPlaceRefCurr.swap(inPlaceRefNext);
+	}
+	Image<float> inPlaceResult(inPlaceBuff2);
+	double inPlaceError = 0.0;
+	for (int y = 0; y < HEIGHT; ++y) {
+		for (int x = 0; x < WIDTH; ++x) {
+			inPlaceError = std::max(inPlaceError, static_cast<double>(std::fabs(inPlaceResult(x, y) - inPlaceRefCurr[y * WIDTH + x])));
+		}
+	}
+	test.expectNear("in-place max error against reference", inPlaceError, 0.0, 1e-4);
+
+	// Ensemble: every instance runs the same drops with its own wave speed
+	Image<float> ensPrev(WIDTH, HEIGHT, INSTANCES);
+	Image<float> ensCurr(WIDTH, HEIGHT, INSTANCES);
+	Image<float> ensNext(WIDTH, HEIGHT, INSTANCES);
+	Image<float> ensScale(WIDTH, HEIGHT, INSTANCES);
+	for (int m = 0; m < INSTANCES; ++m) {
+		for (int y = 0; y < HEIGHT; ++y) {
+			for (int x = 0; x < WIDTH; ++x) {
+				ensPrev(x, y, m) = 0.0f;
+				ensCurr(x, y, m) = (x == WIDTH / 2 && y == HEIGHT / 2) ? 1.0f : 0.0f;
+				ensNext(x, y, m) = 0.0f;
+				ensScale(x, y, m) = 0.1f + 0.1f * m;
+			}
+		}
+	}
+	Buffer ensBuff1(ensPrev);
+	Buffer ensBuff2(ensCurr);
+	Buffer ensBuff3(ensNext);
+	Func ens = WavePropagatorEnsemble(Image<float>(ensBuff1), Image<float>(ensBuff2), ensScale);
+	for (int step = 0; step < 20; ++step) {
+		RealizeInterior(ens, ensBuff3, 1);
+		std::swap(*ensBuff1.raw_buffer(), *ensBuff2.raw_buffer());
+		std::swap(*ensBuff2.raw_buffer(), *ensBuff3.raw_buffer());
+	}
+	Image<float> ensResult(ensBuff2);
+	for (int m = 0; m < INSTANCES; ++m) {
+		std::vector<float> p(WIDTH * HEIGHT, 0.0f), c(WIDTH * HEIGHT, 0.0f), n(WIDTH * HEIGHT, 0.0f);
+		c[(HEIGHT / 2) * WIDTH + WIDTH / 2] = 1.0f;
+		for (int step = 0; step < 20; ++step) {
+			ReferenceStep(p, c, n, 0.1f + 0.1f * m);
+			p.swap(c);
+			c.swap(n);
+		}
+		double error = 0.0;
+		for (int y = 0; y < HEIGHT; ++y) {
+			for (int x = 0; x < WIDTH; ++x) {
+				error = std::max(error, static_cast<double>(std::fabs(ensResult(x, y, m) - c[y * WIDTH + x])));
+			}
+		}
+		test.expectNear("ensemble instance error against reference", error, 0.0, 1e-4);
+	}
+
+	// Every ISA variant this CPU can run gives the same field, each with its own schedule
+	std::vector<float> p(WIDTH * HEIGHT, 0.0f), c(WIDTH * HEIGHT, 0.0f), n(WIDTH * HEIGHT, 0.0f);
+	c[(HEIGHT / 2) * WIDTH + WIDTH / 2] = 1.0f;
+	for (int step = 0; step < 20; ++step) {
+		ReferenceStep(p, c, n, 0.3f);
+		p.swap(c);
+		c.swap(n);
+	}
+	for (int level = ISA_BASELINE; level <= DetectIsa(); ++level) {
+		IsaLevel isa = static_cast<IsaLevel>(level);
+		Buffer isaBuff1(type_of<float>(), WIDTH, HEIGHT);
+		Buffer isaBuff2(type_of<float>(), WIDTH, HEIGHT);
+		Buffer isaBuff3(type_of<float>(), WIDTH, HEIGHT);
+		Image<float> isaPrev(isaBuff1);
+		Image<float> isaCurr(isaBuff2);
+		Image<float> isaNext(isaBuff3);
+		for (int y = 0; y < HEIGHT; ++y) {
+			for (int x = 0; x < WIDTH; ++x) {
+				isaPrev(x, y) = 0.0f;
+				isaCurr(x, y) = (x == WIDTH / 2 && y == HEIGHT / 2) ? 1.0f : 0.0f;
+				isaNext(x, y) = 0.0f;
+			}
+		}
+		Func variant = WavePropagator(Image<float>(isaBuff1), Image<float>(isaBuff2), scale, IsaSchedule(isa));
+		Target target = IsaTarget(isa);
+		variant.compile_jit(target);
+		Timer timer;
+		for (int step = 0; step < 20; ++step) {
+			RealizeInterior(variant, isaBuff3, 1, target);
+			std::swap(*isaBuff1.raw_buffer(), *isaBuff2.raw_buffer());
+			std::swap(*isaBuff2.raw_buffer(), *isaBuff3.raw_buffer());
+		}
+		std::printf("Wave: %s variant %.4f ms/step\n", IsaName(isa), timer.elapsedMs() / 20);
+		Image<float> isaResult(isaBuff2);
+		double error = 0.0;
+		for (int y = 0; y < HEIGHT; ++y) {
+			for (int x = 0; x < WIDTH; ++x) {
+				error = std::max(error, static_cast<double>(std::fabs(isaResult(x, y) - c[y * WIDTH + x])));
+			}
+		}
+		test.expectNear("ISA variant error against reference", error, 0.0, 1e-4);
+	}
+
+	test.checkGolden(Checksum(result), msPerStep, 1e-4);
+	return test.result();
+}
@@ -1,47 +1,40 @@
 #include <cstdio>
+#include <vector>
 
 #include <Halide.h>
 #include <Graphics.h>
+#include <Interior.h>
 #include <Vec.h>
+#include <WavePropagator.h>
+#include <ThreadPool.h>
+#include <Telemetry.h>
 
 using namespace Halide;
 
 namespace HalideExamples {
 
-////////////////////////// WAVE FUNCTION //////////////////////////
+// Write each new field over the previous one, so only two frames are resident
+const bool IN_PLACE = true;
 
-template <typename F1, typename F2, typename F3>
-Func WavePropagator(F1 prev, F2 curr, F3 scale) {
-	Func next;
-	Var x, y, xi, yi, xo, yo;
+// Shade the field in the same pass as the last step before each frame, rather than in a pass of
+// its own. The fused pass shades the field it steps from, so the frame shows the field one step
+// behind the simulation.
+const bool FUSED = true;
 
-	////////////////////////// ALGORITHM //////////////////////////
+// The field is FIELD_SCALE times the screen size in each dimension, and is shown zoomed out to fit
+const int FIELD_SCALE = 2;
 
-	// Discrete 2D wave equation. Forward time centered space (FTCS). There are far more sophisticated methods.
-	next(x, y) = scale(x, y) * (curr(x, y - 1) + curr(x - 1, y) + curr(x + 1, y) + curr(x, y + 1) - 4 * curr(x, y)) + 2 * curr(x, y) - prev(x, y);
-
-	////////////////////////// SCHEDULE //////////////////////////
-
-	// Split the space into 256x256 blocks for parallelization
-	Var tx, ty, nx, ny, ti;
-	next.tile(x, y, tx, ty, nx, ny, 256, 256);
-
-	// Split the blocks into smaller 32x16 tiles, vectorize and unroll
-	next.tile(nx, ny, xo, yo, xi, yi, 32, 16)
-		.vectorize(xi)
-		.unroll(yi);
-
-	// Run all blocks in parallel
-	next.fuse(tx, ty, ti);
-	next.parallel(ti);
-
-	return next;
-}
+// Simulation rate; the frame scheduler drops steps if the machine can't keep up
+const double STEPS_PER_SECOND = 240.0;
+const unsigned int NUM_STEPS = 10000;
 
 ////////////////////////// MAIN DEMO FUNCTION //////////////////////////
 
-void RunDemo(int width, int height) {
+void RunDemo(int screenWidth, int screenHeight) {
 	std::printf("Hello, world!\n");
+	int width = FIELD_SCALE * screenWidth;
+	int height = FIELD_SCALE * screenHeight;
+	Viewport view = FitViewport(width, height);
 
 	// The wave function takes three inputs:
 	//   The previous wave values
@@ -54,13 +47,15 @@ void RunDemo(int width, int height) {
 	// buffer as input to the wave function, but this will not always be the buffer the input comes
 	// from. The solution is to go behind Halide's back and swap out the underlying buffer_t structures
 	// to cycle through the buffers.
+	//
+	// In place, we get away with two: the wave function reads prev only at the point it is
+	// computing, so it can write next over prev. Then prev and curr swap roles for the next step.
 
 	Buffer buff1(type_of<float>(), width, height);
 	Buffer buff2(type_of<float>(), width, height);
-	Buffer buff3(type_of<float>(), width, height);
+	Buffer buff3 = IN_PLACE ? Buffer() : Buffer(type_of<float>(), width, height);
 	Image<float> prev(buff1);
 	Image<float> curr(buff2);
-	Image<float> next(buff3);
 	Image<float> scale(width, height);
 
 	// For shaded output
@@ -72,10 +67,17 @@ void RunDemo(int width, int height) {
 		for (int x = 0; x < width; ++x) {
 			prev(x, y) = 0.0f;
 			curr(x, y) = 0.0f;
-			next(x, y) = 0.0f;
 			scale(x, y) = 0.3f;
 		}
 	}
+	if (!IN_PLACE) {
+		Image<float> next(buff3);
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				next(x, y) = 0.0f;
+			}
+		}
+	}
 	// A single drop of water in the center to start
 	curr(width / 2, height / 2) = 1.0f;
 
@@ -87,62 +89,78 @@ void RunDemo(int width, int height) {
 	}
 
 	Func wv = WavePropagator(Image<float>(buff1), Image<float>(buff2), scale);
+	UseThreadPool(wv);
 
 	Param<float> lx, ly, lz, ex, ey, ez;
 	lx.set(-15000.0f);
 	ly.set(-5000.0f);
 	lz.set(20000.0f);
-	ex.set(640.0f);
-	ey.set(360.0f);
+	ex.set(0.5f * width);
+	ey.set(0.5f * height);
 	ez.set(1000.0f);
 	Func shader = InitializeSpecularShader(curr, lx, ly, lz, ex, ey, ez);
 
-	unsigned int nframes = 0;
-	while (nframes < 10000) {
-		buffer_t* rawbuf = shadebuff.raw_buffer();
-		rawbuf->extent[0] -= 2;
-		rawbuf->extent[1] -= 2;
-		rawbuf->min[0] = 1;
-		rawbuf->min[1] = 1;
-		rawbuf->host += rawbuf->elem_size * (rawbuf->stride[0] + rawbuf->stride[1]);
-		shader.realize(shadebuff);
-		rawbuf->extent[0] += 2;
-		rawbuf->extent[1] += 2;
-		rawbuf->min[0] = 0;
-		rawbuf->min[1] = 0;
-		rawbuf->host -= rawbuf->elem_size * (rawbuf->stride[0] + rawbuf->stride[1]);
-		DisplayImage(shaded, 0.0f, 1.0f);
-
-
+	// The fused pass also realizes telemetry of the field it steps, published for external monitors
+	Func telemetry;
+	Func wvShaded = WavePropagatorShaded(Image<float>(buff1), Image<float>(buff2), scale, lx, ly, lz, ex, ey, ez,
+										 CurrentSchedule(), &telemetry);
+	Pipeline wvShadedPipeline(std::vector<Func>{ wvShaded, telemetry });
+	UseThreadPool(wvShadedPipeline);
+	Buffer partialsbuff(type_of<float>(), height, WAVE_TELEMETRY_COUNT);
+	Image<float> partials(partialsbuff);
+	TelemetryPublisher publisher("HalideExamples.Wave");
+
+	FrameScheduler scheduler(STEPS_PER_SECOND);
+	bool shadedThisFrame = false;
+	auto render = [&]() {
+		// Frames without a step, or unfused, shade on their own
+		if (!shadedThisFrame) {
+			RealizeInterior(shader, shadebuff, 1);
+		}
+		shadedThisFrame = false;
+		DisplayImage(shaded, view, 0.0f, 1.0f);
 		//DisplayImage(curr);
-		// Set the min and extent of the output buffer so we compute only the valid region
-		rawbuf = buff3.raw_buffer();
-		rawbuf->extent[0] -= 2;
-		rawbuf->extent[1] -= 2;
-		rawbuf->min[0] = 1;
-		rawbuf->min[1] = 1;
-		rawbuf->host += rawbuf->elem_size * (rawbuf->stride[0] + rawbuf->stride[1]);
-		// Compute the output
-		wv.realize(buff3);
-		// Restore min and extent
-		rawbuf = buff3.raw_buffer();
-		rawbuf->extent[0] += 2;
-		rawbuf->extent[1] += 2;
-		rawbuf->min[0] = 0;
-		rawbuf->min[1] = 0;
-		rawbuf->host -= rawbuf->elem_size * (rawbuf->stride[0] + rawbuf->stride[1]);
+	};
+	auto step = [&]() {
+		Buffer& output = IN_PLACE ? buff1 : buff3;
+		ShrinkToInterior(output, 1);
+		if (FUSED && scheduler.lastSubstep()) {
+			// Compute the output and shade the current field in one pass
+			ShrinkToInterior(shadebuff, 1);
+			std::vector<Buffer> outputs;
+			outputs.push_back(output);
+			outputs.push_back(shadebuff);
+			outputs.push_back(partialsbuff);
+			wvShadedPipeline.realize(Realization(outputs));
+			RestoreFromInterior(shadebuff, 1);
+			shadedThisFrame = true;
+			publisher.publishAsync(partials, WAVE_TELEMETRY, WAVE_TELEMETRY_COUNT, scheduler.steps());
+		} else {
+			// Compute the output
+			wv.realize(output);
+		}
+		RestoreFromInterior(output, 1);
 		// Cycle through the buffers
-		buffer_t* a;
-		buffer_t* b;
-		buffer_t* c;
-		a = buff1.raw_buffer();
-		b = buff2.raw_buffer();
-		c = buff3.raw_buffer();
-		std::swap(*a, *b);
-		std::swap(*b, *c);
-
-		++nframes;
-	}
+		if (IN_PLACE) {
+			std::swap(*buff1.raw_buffer(), *buff2.raw_buffer());
+		} else {
+			buffer_t* a;
+			buffer_t* b;
+			buffer_t* c;
+			a = buff1.raw_buffer();
+			b = buff2.raw_buffer();
+			c = buff3.raw_buffer();
+			std::swap(*a, *b);
+			std::swap(*b, *c);
+		}
+
+		if (Verbose() && (scheduler.steps() + 1) % 1000 == 0) {
+			std::printf("%.3f ms/step\n", scheduler.stepMs());
+			ThreadPool::shared().printStats();
+			ThreadPool::shared().resetStats();
+		}
+	};
+	scheduler.run(step, render, NUM_STEPS);
 
 }
 